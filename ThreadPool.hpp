@@ -2,8 +2,14 @@
 
 #include <iostream>
 #include <vector>
+#include <list>
 #include <queue>
 #include <memory>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <time.h>
 #include "thread.hpp"
 #include "log.hpp"
 #include "mutex.hpp"
@@ -16,6 +22,41 @@ namespace ThreadPoolModule
     using namespace ConditionModule;
     const int d_num = 5; // 默认线程个数
 
+    // 自适应模式的默认参数
+    const int d_adapt_tick_ms = 100;       // 采样间隔
+    const uint64_t d_adapt_target_us = 1000; // p99排队延迟目标，超过时扩容
+    const int d_adapt_cooldown_ms = 5000;  // 距上次扩容超过冷却时间且利用率低时，每个采样间隔回收一个空闲线程
+    const double d_adapt_idle_util = 0.25; // 低于该利用率认为线程过多
+    const size_t d_adapt_samples = 4096;   // 每个采样间隔最多保留的排队延迟样本数
+
+    inline uint64_t poolNowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 任务带有enqueued_ns成员(CLOCK_MONOTONIC纳秒)时，自适应模式用它计算排队延迟
+    template <class T, class = void>
+    struct HasEnqueuedNs : std::false_type
+    {
+    };
+
+    template <class T>
+    struct HasEnqueuedNs<T, std::void_t<decltype(std::declval<const T &>().enqueued_ns)>> : std::true_type
+    {
+    };
+
+    // 返回任务的入队时间，没有记录时返回0，不参与采样
+    template <class T>
+    uint64_t taskEnqueuedNs(const T &task)
+    {
+        if constexpr (HasEnqueuedNs<T>::value)
+            return task.enqueued_ns;
+        else
+            return 0;
+    }
+
     void test()
     {
     }
@@ -30,16 +71,17 @@ namespace ThreadPoolModule
             return _tasks.empty();
         }
 
-        // 获取并执行任务
-        void get_executeTasks()
+        // 获取并执行任务，self为当前线程对象，被回收时交给监控线程join
+        void get_executeTasks(Thread *self)
         {
             while (true)
             {
                 T t;
+                bool adaptive = false;
                 {
                     // 申请锁
                     MutexGuard guard(_lock);
-                    while (isEmpty() && _isRunning)
+                    while (isEmpty() && _isRunning && _retire == 0)
                     {
                         _wait_num++;
                         _cond.wait(_lock);
@@ -50,33 +92,179 @@ namespace ThreadPoolModule
                     if (isEmpty() && !_isRunning)
                         break;
 
+                    // 自适应模式下空闲线程被要求退出
+                    if (isEmpty() && _retire > 0)
+                    {
+                        _retire--;
+                        _live--;
+                        _exited.push_back(self);
+                        break;
+                    }
+
                     // 此时存在任务，取出任务
                     t = _tasks.front();
                     _tasks.pop();
+
+                    // 记录排队时间，入队时间由任务自己携带
+                    adaptive = _adaptive;
+                    uint64_t enqueued = taskEnqueuedNs(t);
+                    if (adaptive && enqueued)
+                    {
+                        uint64_t wait = poolNowNs() - enqueued;
+                        if (_samples.size() < d_adapt_samples)
+                            _samples.push_back(wait);
+                        else
+                            _samples[_sample_pos++ % d_adapt_samples] = wait;
+                    }
                 }
 
                 // 执行任务之前确保已经释放互斥锁
-                t();
+                if (adaptive)
+                {
+                    uint64_t begin = poolNowNs();
+                    t();
+                    _busy_ns.fetch_add(poolNowNs() - begin, std::memory_order_relaxed);
+                }
+                else
+                    t();
             }
         }
 
-        // 私有构造函数
-        ThreadPool(int num = d_num)
-            : _num(num), _isRunning(false)
+        // 创建一个线程对象，线程函数需要知道自己的线程对象，链表保证地址不变
+        Thread &addThread()
         {
-            // 创建指定个数个线程
-            for (int i = 0; i < _num; i++)
+            MutexGuard guard(_threads_lock);
+            std::shared_ptr<Thread *> self = std::make_shared<Thread *>(nullptr);
+            _threads.emplace_back([this, self]()
+                                  { get_executeTasks(*self); });
+            *self = &_threads.back();
             {
-                _threads.push_back(Thread(std::bind(&ThreadPool<T>::get_executeTasks, this))); // 创建并组织线程，假设当前线程的任务为test
+                // _live与_retire一起在_lock下读写，退出的线程也在_lock下减少它
+                MutexGuard live_guard(_lock);
+                _live++;
+            }
 
-                // 打印相关日志
-                LOG(LogLevel::INFO) << "创建线程：" << _threads.back().getName();
+            // 打印相关日志
+            LOG(LogLevel::INFO) << "创建线程：" << _threads.back().getName();
+            return _threads.back();
+        }
 
-                // 启动线程池
-                // startThreads();
+        // join已经退出的线程并从链表中删除
+        void reapThreads()
+        {
+            std::vector<Thread *> exited;
+            {
+                MutexGuard guard(_lock);
+                exited.swap(_exited);
+            }
+
+            MutexGuard guard(_threads_lock);
+            for (Thread *t : exited)
+            {
+                t->join();
+                LOG(LogLevel::INFO) << "当前线程：" << t->getName() << "被回收";
+                _threads.remove_if([t](Thread &thread)
+                                   { return &thread == t; });
             }
         }
 
+        // 监控线程：按排队延迟扩容，按利用率回收空闲线程
+        void adapt()
+        {
+            uint64_t last_grow = poolNowNs();
+            uint64_t last_tick = last_grow;
+            std::vector<uint64_t> samples;
+            while (true)
+            {
+                usleep(d_adapt_tick_ms * 1000);
+                reapThreads();
+
+                uint64_t now = poolNowNs();
+                size_t live = 0;
+                size_t idle = 0;
+                size_t retiring = 0;
+                size_t min_threads = 0;
+                size_t max_threads = 0;
+                {
+                    MutexGuard guard(_lock);
+                    if (!_isRunning)
+                        break;
+                    samples.swap(_samples);
+                    _samples.clear();
+                    _sample_pos = 0;
+                    live = _live;
+                    idle = _wait_num;
+                    retiring = _retire;
+                    min_threads = _min_threads;
+                    max_threads = _max_threads;
+                }
+
+                // 最少线程数被调高后直接补齐
+                if (live < min_threads)
+                {
+                    for (size_t i = live; i < min_threads; i++)
+                    {
+                        Thread &t = addThread();
+                        t.start();
+                    }
+                    LOG(LogLevel::INFO) << "线程池补齐到最少线程数：" << live << " -> " << min_threads;
+                    last_grow = now;
+                    last_tick = now;
+                    _busy_ns.store(0, std::memory_order_relaxed);
+                    continue;
+                }
+
+                double busy = static_cast<double>(_busy_ns.exchange(0, std::memory_order_relaxed));
+                double util = live ? busy / (static_cast<double>(now - last_tick) * live) : 0;
+                last_tick = now;
+
+                uint64_t p99 = 0;
+                if (!samples.empty())
+                {
+                    size_t i = std::min(samples.size() - 1, samples.size() * 99 / 100);
+                    std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+                    p99 = samples[i];
+                }
+                samples.clear();
+
+                if (p99 > _target_ns && live < max_threads)
+                {
+                    // 每次最多增加一半，避免一次抖动创建过多线程
+                    size_t grow = std::min(max_threads - live, std::max<size_t>(1, live / 2));
+                    for (size_t i = 0; i < grow; i++)
+                    {
+                        Thread &t = addThread();
+                        t.start();
+                    }
+                    last_grow = now;
+                    LOG(LogLevel::INFO) << "线程池扩容：" << live << " -> " << live + grow << " p99排队(us)：" << p99 / 1000.0
+                                        << " 利用率：" << util;
+                }
+                else if (live > min_threads && idle > 0 && retiring == 0 && util < d_adapt_idle_util &&
+                         now - last_grow >= static_cast<uint64_t>(_cooldown_ms) * 1000000)
+                {
+                    {
+                        MutexGuard guard(_lock);
+                        _retire++;
+                        _cond.notify();
+                    }
+                    LOG(LogLevel::INFO) << "线程池缩容：" << live << " -> " << live - 1 << " p99排队(us)：" << p99 / 1000.0
+                                        << " 利用率：" << util;
+                }
+            }
+        }
+
+        // 私有构造函数
+        ThreadPool(int num = d_num)
+            : _num(num), _isRunning(false), _wait_num(0), _live(0), _retire(0),
+              _adaptive(false), _min_threads(num), _max_threads(num), _target_ns(d_adapt_target_us * 1000), _cooldown_ms(d_adapt_cooldown_ms),
+              _sample_pos(0), _busy_ns(0)
+        {
+            // 创建指定个数个线程，启动线程池时再启动
+            for (int i = 0; i < _num; i++)
+                addThread();
+        }
+
         // 禁用拷贝和赋值
         ThreadPool(const ThreadPool &tp) = delete;
         ThreadPool &operator=(ThreadPool &tp) = delete;
@@ -111,11 +299,88 @@ namespace ThreadPoolModule
                 thread.start();
                 LOG(LogLevel::INFO) << "当前线程：" << thread.getName() << "启动";
             }
+
+            if (_adaptive)
+                startMonitor();
+        }
+
+        // 开启自适应模式：线程数在[min_threads, max_threads]之间调整，可以在启动前或启动后调用
+        void enableAdaptive(size_t min_threads, size_t max_threads, uint64_t target_us = d_adapt_target_us, int cooldown_ms = d_adapt_cooldown_ms)
+        {
+            {
+                MutexGuard guard(_lock);
+                if (_adaptive)
+                    return;
+                _min_threads = std::max<size_t>(1, min_threads);
+                _max_threads = std::max(_min_threads, max_threads);
+                _target_ns = target_us * 1000;
+                _cooldown_ms = cooldown_ms;
+                _adaptive = true;
+            }
+            LOG(LogLevel::INFO) << "线程池自适应模式 线程数：" << _min_threads << "~" << _max_threads << " p99排队目标(us)：" << target_us;
+
+            if (_isRunning)
+                startMonitor();
+        }
+
+        // 运行时调整线程数：增加时立即创建，减少时要求多余的线程在空闲后退出
+        // 启动前直接增删还没有运行的线程对象，自适应模式下调整的是最少线程数，由监控线程补齐
+        void setThreads(size_t num)
+        {
+            num = std::max<size_t>(1, num);
+            size_t live = 0;
+            bool running = false;
+            {
+                MutexGuard guard(_lock);
+                if (_adaptive)
+                {
+                    _min_threads = num;
+                    _max_threads = std::max(_max_threads, num);
+                    return;
+                }
+                _num = num;
+                running = _isRunning;
+                live = _live - _retire;
+                if (running && num < live)
+                {
+                    _retire += live - num;
+                    _cond.notifyAll();
+                }
+            }
+
+            if (!running)
+            {
+                MutexGuard guard(_threads_lock);
+                size_t popped = 0;
+                for (; _threads.size() > num; popped++)
+                    _threads.pop_back();
+                MutexGuard live_guard(_lock);
+                _live -= popped;
+            }
+            else
+                reapThreads();
+
+            for (size_t i = live; i < num; i++)
+            {
+                Thread &t = addThread();
+                if (running)
+                    t.start();
+            }
+            LOG(LogLevel::INFO) << "线程池线程数：" << live << " -> " << num;
         }
 
         // 回收线程
         void waitThreads()
         {
+            // 先结束监控线程，之后线程链表不再变化
+            if (_monitor)
+            {
+                _monitor->join();
+                _monitor.reset();
+            }
+            reapThreads();
+
+            MutexGuard guard(_threads_lock);
             for (auto &thread : _threads)
             {
                 thread.join();
@@ -143,6 +408,8 @@ namespace ThreadPoolModule
         // 结束线程
         void stopThreads()
         {
+            MutexGuard guard(_lock);
+
             // 确保线程池处于运行状态
             if (_isRunning)
             {
@@ -160,13 +427,37 @@ namespace ThreadPoolModule
         }
 
     private:
-        std::vector<Thread> _threads; // 组织所有线程
+        void startMonitor()
+        {
+            if (_monitor)
+                return;
+            _monitor = std::make_unique<Thread>([this]()
+                                                { adapt(); });
+            _monitor->start();
+        }
+
+        std::list<Thread> _threads;   // 组织所有线程，链表保证线程对象地址不变
+        Mutex _threads_lock;          // 保护线程链表，运行时调整线程数和监控线程都会修改链表
         size_t _num;                  // 线程个数
         std::queue<T> _tasks;         // 任务队列
         bool _isRunning;              // 用于判断线程池是否处于运行状态
         Mutex _lock;                  // 任务锁
         Condition _cond;              // 任务条件变量
         int _wait_num;                // 等待任务的线程个数
+        size_t _live;                 // 未退出的线程个数，只在_lock下修改
+        size_t _retire;               // 等待退出的空闲线程个数
+        std::vector<Thread *> _exited; // 已退出等待join的线程
+
+        // 自适应模式
+        bool _adaptive;                  // 是否开启自适应模式
+        size_t _min_threads;             // 最少线程数
+        size_t _max_threads;             // 最多线程数
+        uint64_t _target_ns;             // p99排队延迟目标
+        int _cooldown_ms;                // 缩容冷却时间
+        std::vector<uint64_t> _samples;  // 本采样间隔的排队延迟
+        size_t _sample_pos;              // 样本满后循环覆盖的位置
+        std::atomic<uint64_t> _busy_ns;  // 本采样间隔执行任务的总时间
+        std::unique_ptr<Thread> _monitor; // 监控线程
 
         static Mutex _s_lock;                          // 静态单例锁
         static std::shared_ptr<ThreadPool<T>> _tp_ptr; // 单例线程池对象指针
@@ -0,0 +1,568 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <filesystem>
+#include <random>
+#include <time.h>
+#include "mutex.hpp"
+#include "cond.hpp"
+#include "thread.hpp"
+#include "ThreadPool.hpp"
+#include "sockaddr_in_t.hpp"
+#include "log.hpp"
+#include "cookie.hpp"
+#include "sanitize.hpp"
+#include "user.hpp"
+
+namespace BenchMicroModule
+{
+    using namespace MutexModule;
+    using namespace ConditionModule;
+    using namespace ThreadModule;
+    using namespace ThreadPoolModule;
+    using namespace SockAddrInModule;
+    using namespace LogSystemModule;
+    using namespace CookieModule;
+    using namespace SanitizeModule;
+    using namespace UserManageModule;
+
+    const size_t d_bench_iterations = 1000000; // 默认迭代次数，较慢的用例按比例减少
+    const std::string d_bench_log_dir = "./bench_log/";
+
+    inline uint64_t monoNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 防止编译器优化掉被测代码
+    template <class T>
+    inline void keep(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // 单项结果，name在各版本之间保持不变，便于对比
+    struct BenchResult
+    {
+        std::string name;
+        std::string unit;
+        uint64_t iterations;
+        double mean;
+        double p50;
+        double p99;
+    };
+
+    class BenchReport
+    {
+    private:
+        static double percentile(std::vector<uint64_t> &samples, double p)
+        {
+            if (samples.empty())
+                return 0;
+            size_t i = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+            std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+            return static_cast<double>(samples[i]);
+        }
+
+    public:
+        // 记录平均值类结果，没有分位数
+        void add(const std::string &name, const std::string &unit, uint64_t iterations, double mean)
+        {
+            add(BenchResult{name, unit, iterations, mean, mean, mean});
+        }
+
+        // 记录逐次采样的延迟结果
+        void addSamples(const std::string &name, std::vector<uint64_t> &samples)
+        {
+            double sum = 0;
+            for (auto s : samples)
+                sum += s;
+            double mean = samples.empty() ? 0 : sum / samples.size();
+            double p50 = percentile(samples, 0.5);
+            double p99 = percentile(samples, 0.99);
+            add(BenchResult{name, "ns", samples.size(), mean, p50, p99});
+        }
+
+        void add(const BenchResult &r)
+        {
+            _results.push_back(r);
+            char line[256];
+            snprintf(line, sizeof(line), "%-44s %12.1f %-8s p50 %10.1f p99 %10.1f  (%lu)",
+                     r.name.c_str(), r.mean, r.unit.c_str(), r.p50, r.p99, static_cast<unsigned long>(r.iterations));
+            std::cerr << line << std::endl;
+        }
+
+        bool writeCsv(const std::string &path)
+        {
+            std::ofstream out(path);
+            if (!out)
+                return false;
+            out << "name,unit,iterations,mean,p50,p99\n";
+            for (auto &r : _results)
+                out << r.name << "," << r.unit << "," << r.iterations << "," << r.mean << "," << r.p50 << "," << r.p99 << "\n";
+            return true;
+        }
+
+        bool writeJson(const std::string &path)
+        {
+            std::ofstream out(path);
+            if (!out)
+                return false;
+            out << "[\n";
+            for (size_t i = 0; i < _results.size(); i++)
+            {
+                const BenchResult &r = _results[i];
+                out << "  {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"iterations\": " << r.iterations
+                    << ", \"mean\": " << r.mean << ", \"p50\": " << r.p50 << ", \"p99\": " << r.p99 << "}"
+                    << (i + 1 < _results.size() ? "," : "") << "\n";
+            }
+            out << "]\n";
+            return true;
+        }
+
+    private:
+        std::vector<BenchResult> _results;
+    };
+
+    // 线程池按任务类型区分单例，每种线程数使用不同的任务类型
+    template <int N>
+    struct PoolTask
+    {
+        std::function<void()> func;
+
+        void operator()()
+        {
+            func();
+        }
+    };
+
+    // 丢弃所有日志，只测量格式化开销
+    class NullLogStrategy : public LogStrategy
+    {
+    public:
+        virtual void printLog(const std::string &message) override
+        {
+            keep(message.size());
+        }
+    };
+
+    class MicroBench
+    {
+    private:
+        // 无竞争加锁解锁
+        void benchMutex()
+        {
+            Mutex lock;
+            uint64_t n = _iterations;
+            uint64_t begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+            {
+                MutexGuard guard(lock);
+                keep(i);
+            }
+            _report.add("mutex.guard.uncontended", "ns/op", n, double(monoNs() - begin) / n);
+
+            // 两个线程竞争同一把锁
+            uint64_t counter = 0;
+            uint64_t per_thread = n / 4;
+            auto work = [&]()
+            {
+                for (uint64_t i = 0; i < per_thread; i++)
+                {
+                    MutexGuard guard(lock);
+                    counter++;
+                }
+            };
+            Thread t1(work), t2(work);
+            begin = monoNs();
+            t1.start();
+            t2.start();
+            t1.join();
+            t2.join();
+            _report.add("mutex.guard.contended_2t", "ns/op", counter, double(monoNs() - begin) / counter);
+        }
+
+        // 两个线程通过Mutex + Condition来回传递，单程耗时即唤醒延迟
+        void benchCondition()
+        {
+            Mutex lock;
+            Condition ping, pong;
+            int turn = 0;
+            uint64_t rounds = _iterations / 20;
+            std::vector<uint64_t> samples;
+            samples.reserve(rounds);
+            uint64_t sent_ns = 0;
+
+            Thread peer([&]()
+                        {
+                            for (uint64_t i = 0; i < rounds; i++)
+                            {
+                                MutexGuard guard(lock);
+                                while (turn != 1)
+                                    ping.wait(lock);
+                                samples.push_back(monoNs() - sent_ns);
+                                turn = 0;
+                                pong.notify();
+                            } });
+            peer.start();
+
+            for (uint64_t i = 0; i < rounds; i++)
+            {
+                MutexGuard guard(lock);
+                sent_ns = monoNs();
+                turn = 1;
+                ping.notify();
+                while (turn != 0)
+                    pong.wait(lock);
+            }
+            peer.join();
+            _report.addSamples("cond.handoff", samples);
+        }
+
+        // 线程池：空闲时单个任务从插入到开始执行的延迟，以及批量插入的吞吐
+        template <int N>
+        void benchThreadPool()
+        {
+            using task_t = PoolTask<N>;
+            std::shared_ptr<ThreadPool<task_t>> tp = ThreadPool<task_t>::getInstance(N);
+            tp->startThreads();
+
+            uint64_t rounds = _iterations / 50;
+            std::vector<uint64_t> samples(rounds);
+            std::atomic<uint64_t> done(0);
+            for (uint64_t i = 0; i < rounds; i++)
+            {
+                uint64_t pushed = monoNs();
+                task_t task{[&samples, &done, i, pushed]()
+                            {
+                                samples[i] = monoNs() - pushed;
+                                done.fetch_add(1, std::memory_order_release);
+                            }};
+                tp->pushTasks(task);
+                // 等待执行完成，测量的是空闲线程的唤醒延迟
+                while (done.load(std::memory_order_acquire) <= i)
+                    ;
+            }
+            _report.addSamples("threadpool.push_to_exec.t" + std::to_string(N), samples);
+
+            uint64_t total = _iterations / 5;
+            done = 0;
+            uint64_t begin = monoNs();
+            for (uint64_t i = 0; i < total; i++)
+            {
+                task_t task{[&done]()
+                            { done.fetch_add(1, std::memory_order_relaxed); }};
+                tp->pushTasks(task);
+            }
+            while (done.load(std::memory_order_relaxed) < total)
+                usleep(100);
+            double seconds = double(monoNs() - begin) / 1e9;
+            _report.add("threadpool.throughput.t" + std::to_string(N), "tasks/s", total, total / seconds);
+
+            tp->stopThreads();
+            tp->waitThreads();
+        }
+
+        void benchSockAddrIn()
+        {
+            uint64_t n = _iterations;
+            uint64_t begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+            {
+                SockAddrIn addr(static_cast<uint16_t>(i), "127.0.0.1");
+                keep(addr.getAddr());
+            }
+            _report.add("sockaddr.construct.port_ip", "ns/op", n, double(monoNs() - begin) / n);
+
+            struct sockaddr_in raw = SockAddrIn(8080, "192.168.100.200").getAddr();
+            begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+            {
+                raw.sin_port = static_cast<uint16_t>(i);
+                SockAddrIn addr(raw);
+                keep(addr.getAddr());
+            }
+            _report.add("sockaddr.construct.sockaddr_in", "ns/op", n, double(monoNs() - begin) / n);
+
+            SockAddrIn a(8080, "192.168.100.200"), b(8080, "192.168.100.200");
+            bool equal = false;
+            begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+            {
+                equal = a == b;
+                keep(equal);
+            }
+            _report.add("sockaddr.equal", "ns/op", n, double(monoNs() - begin) / n);
+        }
+
+        // 上线握手的cookie生成和验证，验证在接收线程中对每个上线回复执行
+        void benchCookie()
+        {
+            CookieJar jar;
+            struct sockaddr_in addr = SockAddrIn(8080, "192.168.100.200").getAddr();
+            uint64_t n = _iterations;
+            uint64_t begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+            {
+                addr.sin_port = static_cast<uint16_t>(i);
+                keep(jar.challenge(addr).size());
+            }
+            _report.add("cookie.challenge", "ns/op", n, double(monoNs() - begin) / n);
+
+            std::string response = jar.challenge(addr) + "name:online";
+            const char *payload = nullptr;
+            size_t payload_len = 0;
+            begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+                keep(jar.verify(response.data(), response.size(), addr, payload, payload_len));
+            _report.add("cookie.verify", "ns/op", n, double(monoNs() - begin) / n);
+
+            // 伪造的cookie同样要完整计算一次MAC
+            response[frame_head_size + 1] ^= 1;
+            begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+                keep(jar.verify(response.data(), response.size(), addr, payload, payload_len));
+            _report.add("cookie.verify_forged", "ns/op", n, double(monoNs() - begin) / n);
+        }
+
+        // 分发热循环：读取每个接收者的地址并填写mmsghdr，与UserManager::sendBatch相同，只是不调用sendmmsg
+        template <class AddrOf>
+        static void fillBatches(size_t n, AddrOf addrOf)
+        {
+            struct iovec iov[2] = {};
+            struct mmsghdr msgs[d_send_batch];
+            size_t k = 0;
+            uint32_t touched = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                const struct sockaddr_in *addr = addrOf(i);
+                // 内核发送时会读取地址，这里同样读一次
+                touched ^= addr->sin_addr.s_addr ^ addr->sin_port;
+
+                struct msghdr &hdr = msgs[k].msg_hdr;
+                memset(&hdr, 0, sizeof(hdr));
+                hdr.msg_name = const_cast<struct sockaddr_in *>(addr);
+                hdr.msg_namelen = sizeof(struct sockaddr_in);
+                hdr.msg_iov = iov;
+                hdr.msg_iovlen = 2;
+                if (++k == d_send_batch)
+                {
+                    keep(msgs);
+                    k = 0;
+                }
+            }
+            keep(msgs);
+            keep(touched);
+        }
+
+        // 每个接收者的分发开销：连续的地址快照与每个用户一个堆对象的旧布局对比
+        // 旧布局的指针数组打乱顺序，模拟长时间上线下线后用户对象在堆上的分布
+        void benchFanout()
+        {
+            for (size_t users : {10000, 100000})
+            {
+                std::string label = std::to_string(users / 1000) + "k";
+                uint64_t rounds = std::max<uint64_t>(1, _iterations * 10 / users);
+
+                std::vector<std::shared_ptr<User>> objects;
+                RecipientTable table;
+                NameTable names;
+                objects.reserve(users);
+                for (size_t i = 0; i < users; i++)
+                {
+                    std::string name = "user" + std::to_string(i);
+                    objects.push_back(std::make_shared<User>(static_cast<uint16_t>(10000 + i % 50000), "10.0." + std::to_string(i / 50000) + ".1", name));
+                    table.add(objects.back()->getAddr(), names.intern(name), objects.back()->getPrefix());
+                }
+                std::shuffle(objects.begin(), objects.end(), std::mt19937(1));
+                recipient_list_t snapshot = table.unicastList();
+
+                uint64_t begin = monoNs();
+                for (uint64_t r = 0; r < rounds; r++)
+                    fillBatches(users, [&objects](size_t i)
+                                { return &objects[i]->getAddr(); });
+                _report.add("fanout.shared_ptr." + label, "ns/recipient", rounds * users, double(monoNs() - begin) / (rounds * users));
+
+                begin = monoNs();
+                for (uint64_t r = 0; r < rounds; r++)
+                    fillBatches(users, [&snapshot](size_t i)
+                                { return &snapshot[i]; });
+                _report.add("fanout.soa." + label, "ns/recipient", rounds * users, double(monoNs() - begin) / (rounds * users));
+
+                // 增删用户：交换删除加重新插入
+                begin = monoNs();
+                std::mt19937 rng(2);
+                for (size_t i = 0; i < users; i++)
+                {
+                    recipient_handle_t handle = static_cast<recipient_handle_t>(rng() % users);
+                    RecipientInfo info = table.getInfo(handle);
+                    struct sockaddr_in addr = table.getAddr(handle);
+                    table.remove(handle);
+                    keep(table.add(addr, info.name, info.prefix));
+                }
+                _report.add("fanout.churn." + label, "ns/op", users, double(monoNs() - begin) / users);
+            }
+        }
+
+        // 接收路径上的消息检查：原来只用find找分隔符，现在同时校验UTF-8和控制字符
+        void benchSanitize()
+        {
+            std::string chinese;
+            while (chinese.size() < 500)
+                chinese += "\xe4\xbd\xa0\xe5\xa5\xbd\xef\xbc\x8c\xe4\xb8\x96\xe7\x95\x8c abc ";
+            std::vector<std::pair<std::string, std::string>> payloads = {
+                {"ascii64", "alice:" + std::string(58, 'x')},
+                {"ascii512", "alice:" + std::string(506, 'x')},
+                {"utf8_512", "alice:" + chinese.substr(0, 506)},
+                {"control512", "alice:" + std::string(250, 'x') + "\x1b[2J" + std::string(252, 'x')},
+            };
+
+            std::vector<ScanKernel> kernels = {{"scalar", [](const char *data, size_t len)
+                                                { return scanScalar(data, len); }}};
+#if defined(__x86_64__)
+            kernels.push_back({"sse2", scanSse2});
+            if (__builtin_cpu_supports("avx2"))
+                kernels.push_back({"avx2", scanAvx2});
+#endif
+
+            uint64_t n = _iterations;
+            for (auto &payload : payloads)
+            {
+                const std::string &data = payload.second;
+                uint64_t begin = monoNs();
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    keep(data.data());
+                    keep(data.find(':'));
+                }
+                _report.add("sanitize.find." + payload.first, "ns/op", n, double(monoNs() - begin) / n);
+
+                for (auto &kernel : kernels)
+                {
+                    begin = monoNs();
+                    for (uint64_t i = 0; i < n; i++)
+                    {
+                        keep(data.data());
+                        keep(kernel.scan(data.data(), data.size()).colon);
+                    }
+                    _report.add("sanitize." + std::string(kernel.name) + "." + payload.first, "ns/op", n, double(monoNs() - begin) / n);
+                }
+            }
+
+            // 有问题的消息还要改写一遍
+            std::string out;
+            const std::string &dirty = payloads.back().second;
+            n = _iterations / 10;
+            uint64_t begin = monoNs();
+            for (uint64_t i = 0; i < n; i++)
+                keep(sanitize(dirty.data(), dirty.size(), out));
+            _report.add("sanitize.rewrite.control512", "ns/op", n, double(monoNs() - begin) / n);
+        }
+
+        // 每个等级和输出方式格式化一条典型日志的开销
+        void benchLog()
+        {
+            const LogLevel levels[] = {LogLevel::DEBUG, LogLevel::INFO, LogLevel::WARNING, LogLevel::ERROR, LogLevel::FATAL};
+            const char *names[] = {"debug", "info", "warning", "error", "fatal"};
+            uint64_t n = _iterations / 10;
+            std::string message(32, 'x');
+
+            std::filesystem::create_directories(d_bench_log_dir);
+
+            // 控制台输出重定向到/dev/null
+            std::ofstream devnull("/dev/null");
+            std::streambuf *saved = std::cout.rdbuf(devnull.rdbuf());
+
+            struct Sink
+            {
+                const char *name;
+                std::function<void(LogHandler &)> setup;
+            };
+            std::vector<Sink> sinks = {
+                {"null", [](LogHandler &h)
+                 { h.enableCustomLog(std::make_shared<NullLogStrategy>()); }},
+                {"console", [](LogHandler &h)
+                 { h.enableConsoleLog(); }},
+                {"file", [](LogHandler &h)
+                 { h.enableCustomLog(std::make_shared<FileLogStrategy>(d_bench_log_dir, "bench.txt")); }},
+            };
+
+            for (auto &sink : sinks)
+                for (size_t l = 0; l < 5; l++)
+                {
+                    LogHandler handler;
+                    sink.setup(handler);
+                    uint64_t begin = monoNs();
+                    for (uint64_t i = 0; i < n; i++)
+                        handler(levels[l], __FILE__, __LINE__) << "send message: " << message << " to: 127.0.0.1:" << i;
+                    _report.add(std::string("log.") + sink.name + "." + names[l], "ns/op", n, double(monoNs() - begin) / n);
+                }
+
+            std::cout.rdbuf(saved);
+
+            // 二进制日志只写入线程缓冲区，等级不影响开销
+            {
+                LogHandler handler;
+                handler.enableBinaryLog(d_bench_log_dir, "bench.bin");
+                uint32_t site = handler.registerSite(LogLevel::INFO, __FILE__, __LINE__, "send message: {} to: {}");
+                struct sockaddr_in addr = SockAddrIn(8080, "127.0.0.1").getAddr();
+                uint64_t begin = monoNs();
+                for (uint64_t i = 0; i < n; i++)
+                    handler.logFormat(site, LogLevel::INFO, __FILE__, __LINE__, "send message: {} to: {}", message, addr);
+                _report.add("log.binary.info", "ns/op", n, double(monoNs() - begin) / n);
+            }
+
+            std::error_code ec;
+            std::filesystem::remove_all(d_bench_log_dir, ec);
+        }
+
+    public:
+        MicroBench(BenchReport &report, uint64_t iterations = d_bench_iterations)
+            : _report(report), _iterations(iterations)
+        {
+        }
+
+        // filter为空时运行所有用例，否则只运行名称前缀匹配的用例
+        void run(const std::string &filter)
+        {
+            auto selected = [&filter](const std::string &group)
+            {
+                return filter.empty() || group.compare(0, filter.size(), filter) == 0 || filter.compare(0, group.size(), group) == 0;
+            };
+
+            if (selected("mutex"))
+                benchMutex();
+            if (selected("cond"))
+                benchCondition();
+            if (selected("threadpool"))
+            {
+                benchThreadPool<1>();
+                benchThreadPool<2>();
+                benchThreadPool<4>();
+                benchThreadPool<8>();
+            }
+            if (selected("sockaddr"))
+                benchSockAddrIn();
+            if (selected("log"))
+                benchLog();
+            if (selected("cookie"))
+                benchCookie();
+            if (selected("fanout"))
+                benchFanout();
+            if (selected("sanitize"))
+                benchSanitize();
+        }
+
+    private:
+        BenchReport &_report;
+        uint64_t _iterations;
+    };
+}
@@ -0,0 +1,57 @@
+#include "bench_micro.hpp"
+#include "log.hpp"
+#include <getopt.h>
+
+using namespace BenchMicroModule;
+using namespace LogSystemModule;
+
+void usage(const char *proc)
+{
+    LOG(LogLevel::ERROR) << "错误使用，正确使用：" << proc << " [-n 迭代次数] [-o CSV文件] [-j JSON文件] [-f 用例前缀(mutex/cond/threadpool/sockaddr/log/cookie/fanout/sanitize)]";
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t iterations = d_bench_iterations;
+    std::string csv_path;
+    std::string json_path;
+    std::string filter;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "n:o:j:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = std::stoull(optarg);
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(4);
+        }
+    }
+
+    // 线程池等组件自身的日志不参与测量
+    loghandler.enableCustomLog(std::make_shared<NullLogStrategy>());
+
+    BenchReport report;
+    MicroBench bench(report, iterations);
+    bench.run(filter);
+
+    loghandler.enableConsoleLog();
+    if (!csv_path.empty() && !report.writeCsv(csv_path))
+        LOG(LogLevel::ERROR) << "写入CSV失败：" << csv_path;
+    if (!json_path.empty() && !report.writeJson(json_path))
+        LOG(LogLevel::ERROR) << "写入JSON失败：" << json_path;
+
+    return 0;
+}
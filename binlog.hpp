@@ -0,0 +1,356 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <type_traits>
+#include <cstring>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "mutex.hpp"
+
+namespace BinaryLogModule
+{
+    using namespace MutexModule;
+
+    // 二进制日志文件格式：
+    // 文件头：["ULOG"][版本 4B][pid 4B]
+    // 调用点记录：['S'][调用点ID 4B][等级 1B][文件名长度 2B][文件名][行号 4B][格式串长度 2B][格式串]
+    // 日志记录：['E'][调用点ID 4B][时间戳ns 8B][参数个数 1B][参数...]
+    // 参数：['i'][int64] / ['u'][uint64] / ['d'][double] / ['s'][长度 4B][字节] / ['a'][IPv4 4B][端口 2B]
+    // 整数按本机字节序保存，只在同一台机器上解码
+    const char binlog_magic[4] = {'U', 'L', 'O', 'G'};
+    const uint32_t binlog_version = 1;
+    const char site_tag = 'S';
+    const char event_tag = 'E';
+
+    const size_t d_binlog_buffer = 64 * 1024; // 每个线程的缓冲区，超过时写入文件
+    const uint64_t d_binlog_flush_ns = 1000000000ULL; // 缓冲区最长保留时间
+
+    // 调用点信息，格式串中的{}依次替换为参数
+    struct CallSite
+    {
+        uint32_t id;
+        int level;
+        std::string file;
+        uint32_t line;
+        std::string fmt;
+    };
+
+    template <class T>
+    void putRaw(std::string &buf, const T &value)
+    {
+        buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template <class T>
+    T getRaw(const char *data)
+    {
+        T value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline void encodeArg(std::string &buf, std::string_view s)
+    {
+        buf += 's';
+        putRaw(buf, static_cast<uint32_t>(s.size()));
+        buf.append(s.data(), s.size());
+    }
+
+    inline void encodeArg(std::string &buf, const std::string &s)
+    {
+        encodeArg(buf, std::string_view(s));
+    }
+
+    inline void encodeArg(std::string &buf, const char *s)
+    {
+        encodeArg(buf, std::string_view(s ? s : ""));
+    }
+
+    // 地址只记录原始值，解码时再转换为"ip:port"
+    inline void encodeArg(std::string &buf, const struct sockaddr_in &addr)
+    {
+        buf += 'a';
+        putRaw(buf, addr.sin_addr.s_addr);
+        putRaw(buf, addr.sin_port);
+    }
+
+    template <class T>
+    typename std::enable_if<std::is_arithmetic<T>::value>::type encodeArg(std::string &buf, T value)
+    {
+        if constexpr (std::is_floating_point<T>::value)
+        {
+            buf += 'd';
+            putRaw(buf, static_cast<double>(value));
+        }
+        else if constexpr (std::is_signed<T>::value)
+        {
+            buf += 'i';
+            putRaw(buf, static_cast<int64_t>(value));
+        }
+        else
+        {
+            buf += 'u';
+            putRaw(buf, static_cast<uint64_t>(value));
+        }
+    }
+
+    // 解码一条日志的参数，数据不完整时返回false
+    inline bool decodeArgs(const char *data, size_t len, size_t argc, size_t &off, std::vector<std::string> &args)
+    {
+        for (size_t i = 0; i < argc; i++)
+        {
+            if (off >= len)
+                return false;
+            char type = data[off++];
+            switch (type)
+            {
+            case 'i':
+                if (off + 8 > len)
+                    return false;
+                args.push_back(std::to_string(getRaw<int64_t>(data + off)));
+                off += 8;
+                break;
+            case 'u':
+                if (off + 8 > len)
+                    return false;
+                args.push_back(std::to_string(getRaw<uint64_t>(data + off)));
+                off += 8;
+                break;
+            case 'd':
+            {
+                if (off + 8 > len)
+                    return false;
+                char number[64];
+                snprintf(number, sizeof(number), "%g", getRaw<double>(data + off));
+                args.push_back(number);
+                off += 8;
+                break;
+            }
+            case 's':
+            {
+                if (off + 4 > len)
+                    return false;
+                uint32_t n = getRaw<uint32_t>(data + off);
+                off += 4;
+                if (off + n > len)
+                    return false;
+                args.emplace_back(data + off, n);
+                off += n;
+                break;
+            }
+            case 'a':
+            {
+                if (off + 6 > len)
+                    return false;
+                struct in_addr ip;
+                ip.s_addr = getRaw<uint32_t>(data + off);
+                char buffer[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &ip, buffer, sizeof(buffer));
+                args.push_back(std::string(buffer) + ":" + std::to_string(ntohs(getRaw<uint16_t>(data + off + 4))));
+                off += 6;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 将格式串中的{}依次替换为参数，多出的参数追加在末尾
+    inline std::string formatMessage(const std::string &fmt, const std::vector<std::string> &args)
+    {
+        std::string out;
+        size_t pos = 0;
+        size_t i = 0;
+        while (true)
+        {
+            size_t mark = fmt.find("{}", pos);
+            if (mark == std::string::npos || i == args.size())
+                break;
+            out.append(fmt, pos, mark - pos);
+            out += args[i++];
+            pos = mark + 2;
+        }
+        out.append(fmt, pos, std::string::npos);
+        for (; i < args.size(); i++)
+            out += " " + args[i];
+        return out;
+    }
+
+    inline uint64_t realtimeNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 二进制日志写入器：调用点注册一次，之后每条日志只写调用点ID、时间戳和参数原始值
+    // 日志先写入线程本地缓冲区，缓冲区满或者超过最长保留时间后批量写入文件
+    class BinaryLogWriter
+    {
+    private:
+        struct LocalBuffer
+        {
+            std::string data;
+            uint64_t last_flush_ns = 0;
+            BinaryLogWriter *owner = nullptr;
+
+            ~LocalBuffer()
+            {
+                // 线程退出时写入剩余的日志
+                if (owner && !data.empty())
+                    owner->flush(*this);
+            }
+        };
+
+        static LocalBuffer &local()
+        {
+            static thread_local LocalBuffer buffer;
+            return buffer;
+        }
+
+        static std::string siteRecord(const CallSite &site)
+        {
+            std::string record;
+            record += site_tag;
+            putRaw(record, site.id);
+            record += static_cast<char>(site.level);
+            putRaw(record, static_cast<uint16_t>(site.file.size()));
+            record += site.file;
+            putRaw(record, site.line);
+            putRaw(record, static_cast<uint16_t>(site.fmt.size()));
+            record += site.fmt;
+            return record;
+        }
+
+        // 调用方持有_lock
+        void writeAll(const char *data, size_t len)
+        {
+            while (len > 0)
+            {
+                ssize_t ret = ::write(_fd, data, len);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    _write_errors++;
+                    return;
+                }
+                data += ret;
+                len -= ret;
+            }
+        }
+
+        void flush(LocalBuffer &buffer)
+        {
+            MutexGuard guard(_lock);
+            if (_fd >= 0)
+                writeAll(buffer.data.data(), buffer.data.size());
+            buffer.data.clear();
+        }
+
+    public:
+        BinaryLogWriter()
+            : _fd(-1), _write_errors(0)
+        {
+        }
+
+        BinaryLogWriter(const BinaryLogWriter &) = delete;
+        BinaryLogWriter &operator=(const BinaryLogWriter &) = delete;
+
+        // 打开日志文件并写入文件头和已经注册过的调用点
+        bool open(const std::string &path)
+        {
+            MutexGuard guard(_lock);
+            if (_fd >= 0)
+                ::close(_fd);
+
+            _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+            if (_fd < 0)
+                return false;
+
+            std::string head(binlog_magic, sizeof(binlog_magic));
+            putRaw(head, binlog_version);
+            putRaw(head, static_cast<uint32_t>(getpid()));
+            for (auto &site : _sites)
+                head += siteRecord(site);
+            writeAll(head.data(), head.size());
+            return true;
+        }
+
+        bool isOpen()
+        {
+            return _fd >= 0;
+        }
+
+        // 每个调用点只注册一次，注册时写入调用点记录
+        uint32_t registerSite(int level, const std::string &file, int line, const std::string &fmt)
+        {
+            MutexGuard guard(_lock);
+            CallSite site{static_cast<uint32_t>(_sites.size()), level, file, static_cast<uint32_t>(line), fmt};
+            _sites.push_back(site);
+            if (_fd >= 0)
+            {
+                std::string record = siteRecord(site);
+                writeAll(record.data(), record.size());
+            }
+            return site.id;
+        }
+
+        CallSite getSite(uint32_t id)
+        {
+            MutexGuard guard(_lock);
+            return _sites[id];
+        }
+
+        template <class... Args>
+        void write(uint32_t site, const Args &...args)
+        {
+            LocalBuffer &buffer = local();
+            buffer.owner = this;
+
+            uint64_t now = realtimeNs();
+            buffer.data += event_tag;
+            putRaw(buffer.data, site);
+            putRaw(buffer.data, now);
+            buffer.data += static_cast<char>(sizeof...(args));
+            (encodeArg(buffer.data, args), ...);
+
+            if (buffer.data.size() >= d_binlog_buffer || now - buffer.last_flush_ns >= d_binlog_flush_ns)
+            {
+                buffer.last_flush_ns = now;
+                flush(buffer);
+            }
+        }
+
+        // 写入当前线程缓冲区中的日志
+        void flush()
+        {
+            LocalBuffer &buffer = local();
+            if (!buffer.data.empty())
+                flush(buffer);
+        }
+
+        ~BinaryLogWriter()
+        {
+            flush();
+            if (_fd >= 0)
+                ::close(_fd);
+            if (_write_errors)
+                std::cerr << "binary log write errors: " << _write_errors << std::endl;
+        }
+
+    private:
+        int _fd;
+        std::vector<CallSite> _sites; // 按ID排列的调用点
+        uint64_t _write_errors;
+        Mutex _lock;
+    };
+}
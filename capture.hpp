@@ -0,0 +1,206 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include "log.hpp"
+
+namespace CaptureModule
+{
+    using namespace LogSystemModule;
+
+    // 抓包文件格式：
+    // 文件头：["UCAP"][版本 4B]
+    // 记录：[时间戳ns 8B][IPv4 4B][端口 2B][长度 2B][数据]
+    // 时间戳为CLOCK_MONOTONIC，只用于计算相对间隔；地址和端口保持网络字节序，其余按本机字节序
+    const char capture_magic[4] = {'U', 'C', 'A', 'P'};
+    const uint32_t capture_version = 1;
+    const size_t capture_head_size = 8;
+    const size_t capture_record_head_size = 16;
+
+    const size_t d_capture_buffer = 1024 * 1024; // 写入缓冲区，满时写入文件
+
+    struct CaptureRecord
+    {
+        uint64_t ts_ns;
+        struct sockaddr_in from;
+        std::string data;
+    };
+
+    inline uint64_t monotonicNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 记录服务器收到的每个报文，只在接收线程中使用
+    class CaptureWriter
+    {
+    private:
+        void flush()
+        {
+            size_t off = 0;
+            while (off < _buffer.size())
+            {
+                ssize_t ret = ::write(_fd, _buffer.data() + off, _buffer.size() - off);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    LOG(LogLevel::WARNING) << "写入抓包文件失败：" << strerror(errno);
+                    break;
+                }
+                off += ret;
+            }
+            _buffer.clear();
+        }
+
+    public:
+        CaptureWriter()
+            : _fd(-1), _records(0), _bytes(0)
+        {
+        }
+
+        CaptureWriter(const CaptureWriter &) = delete;
+        CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+        bool open(const std::string &path)
+        {
+            _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (_fd < 0)
+                return false;
+
+            _path = path;
+            _buffer.reserve(d_capture_buffer + capture_record_head_size + 65536);
+            _buffer.append(capture_magic, sizeof(capture_magic));
+            _buffer.append(reinterpret_cast<const char *>(&capture_version), sizeof(capture_version));
+            return true;
+        }
+
+        void record(const char *data, size_t len, const struct sockaddr_in &from)
+        {
+            if (_fd < 0 || len > 0xffff)
+                return;
+
+            uint64_t ts = monotonicNs();
+            uint16_t n = static_cast<uint16_t>(len);
+            _buffer.append(reinterpret_cast<const char *>(&ts), sizeof(ts));
+            _buffer.append(reinterpret_cast<const char *>(&from.sin_addr.s_addr), 4);
+            _buffer.append(reinterpret_cast<const char *>(&from.sin_port), 2);
+            _buffer.append(reinterpret_cast<const char *>(&n), 2);
+            _buffer.append(data, len);
+            _records++;
+            _bytes += len;
+
+            if (_buffer.size() >= d_capture_buffer)
+                flush();
+        }
+
+        ~CaptureWriter()
+        {
+            if (_fd < 0)
+                return;
+
+            flush();
+            fdatasync(_fd);
+            ::close(_fd);
+            LOG(LogLevel::INFO) << "抓包文件：" << _path << " 报文数：" << _records << " 字节数：" << _bytes;
+        }
+
+    private:
+        int _fd;
+        std::string _path;
+        std::string _buffer;
+        uint64_t _records;
+        uint64_t _bytes;
+    };
+
+    // 顺序读取抓包文件
+    class CaptureReader
+    {
+    public:
+        CaptureReader()
+            : _fd(-1)
+        {
+        }
+
+        CaptureReader(const CaptureReader &) = delete;
+        CaptureReader &operator=(const CaptureReader &) = delete;
+
+        bool open(const std::string &path)
+        {
+            _fd = ::open(path.c_str(), O_RDONLY);
+            if (_fd < 0)
+                return false;
+
+            char head[capture_head_size];
+            if (::read(_fd, head, sizeof(head)) != static_cast<ssize_t>(sizeof(head)) ||
+                memcmp(head, capture_magic, sizeof(capture_magic)) != 0)
+            {
+                ::close(_fd);
+                _fd = -1;
+                errno = EINVAL;
+                return false;
+            }
+
+            uint32_t version = 0;
+            memcpy(&version, head + 4, sizeof(version));
+            if (version != capture_version)
+            {
+                ::close(_fd);
+                _fd = -1;
+                errno = EINVAL;
+                return false;
+            }
+            return true;
+        }
+
+        // 读取下一条记录，文件结束或者记录不完整时返回false
+        bool next(CaptureRecord &r)
+        {
+            char head[capture_record_head_size];
+            if (!readFull(head, sizeof(head)))
+                return false;
+
+            uint16_t len = 0;
+            memcpy(&r.ts_ns, head, 8);
+            memset(&r.from, 0, sizeof(r.from));
+            r.from.sin_family = AF_INET;
+            memcpy(&r.from.sin_addr.s_addr, head + 8, 4);
+            memcpy(&r.from.sin_port, head + 12, 2);
+            memcpy(&len, head + 14, 2);
+
+            r.data.resize(len);
+            return readFull(&r.data[0], len);
+        }
+
+        ~CaptureReader()
+        {
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+
+    private:
+        bool readFull(char *buf, size_t len)
+        {
+            size_t got = 0;
+            while (got < len)
+            {
+                ssize_t ret = ::read(_fd, buf + got, len - got);
+                if (ret < 0 && errno == EINTR)
+                    continue;
+                if (ret <= 0)
+                    return false;
+                got += ret;
+            }
+            return true;
+        }
+
+        int _fd;
+    };
+}
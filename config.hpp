@@ -0,0 +1,276 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <functional>
+#include <signal.h>
+#include <time.h>
+#include "log.hpp"
+#include "thread.hpp"
+#include "mutex.hpp"
+
+namespace ConfigModule
+{
+    using namespace LogSystemModule;
+    using namespace ThreadModule;
+    using namespace MutexModule;
+
+    // 服务器可调参数，配置文件为"键 = 值"格式，#开头为注释：
+    //   data_threads = 5      数据通道线程数，开启自适应模式时为最少线程数
+    //   queue_limit = 0       等待执行的分发任务上限，超过时丢弃新消息，0表示不限制
+    //   log_level = debug     最低日志等级：debug/info/warning/error/fatal
+    //   log_sink = console    文本日志输出：console/file，binary只能在启动时设置
+    //   recv_buffer = 0       套接字接收缓冲区字节数，0表示不修改
+    //   send_buffer = 0       套接字发送缓冲区字节数，0表示不修改
+    //   send_batch = 64       每次sendmmsg最多发送的消息数
+    // 文件中没有出现的键使用启动参数决定的值，删除某个键后重新加载会恢复该值
+    struct ServerConfig
+    {
+        size_t data_threads = 0;
+        size_t queue_limit = 0;
+        LogLevel log_level = LogLevel::DEBUG;
+        std::string log_sink = "console";
+        int recv_buffer = 0;
+        int send_buffer = 0;
+        size_t send_batch = 0;
+    };
+
+    const size_t max_config_threads = 1024;
+    const int max_config_buffer = 1 << 30;
+
+    inline std::string level2name(LogLevel level)
+    {
+        switch (level)
+        {
+        case LogLevel::DEBUG:
+            return "debug";
+        case LogLevel::INFO:
+            return "info";
+        case LogLevel::WARNING:
+            return "warning";
+        case LogLevel::ERROR:
+            return "error";
+        case LogLevel::FATAL:
+            return "fatal";
+        }
+        return "unknown";
+    }
+
+    inline bool name2level(const std::string &name, LogLevel &level)
+    {
+        const LogLevel levels[] = {LogLevel::DEBUG, LogLevel::INFO, LogLevel::WARNING, LogLevel::ERROR, LogLevel::FATAL};
+        for (LogLevel l : levels)
+            if (level2name(l) == name)
+            {
+                level = l;
+                return true;
+            }
+        return false;
+    }
+
+    // 生效配置的单行描述
+    inline std::string describeConfig(const ServerConfig &config)
+    {
+        std::ostringstream out;
+        out << "data_threads=" << config.data_threads << " queue_limit=" << config.queue_limit
+            << " log_level=" << level2name(config.log_level) << " log_sink=" << config.log_sink
+            << " recv_buffer=" << config.recv_buffer << " send_buffer=" << config.send_buffer
+            << " send_batch=" << config.send_batch;
+        return out.str();
+    }
+
+    inline std::string trim(const std::string &s)
+    {
+        size_t first = s.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            return std::string();
+        size_t last = s.find_last_not_of(" \t\r");
+        return s.substr(first, last - first + 1);
+    }
+
+    // 在base的基础上读取配置文件，出错时返回false并给出出错的行，config不被修改
+    inline bool loadConfig(const std::string &path, const ServerConfig &base, size_t max_send_batch, ServerConfig &config, std::string &error)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            error = "无法打开：" + path;
+            return false;
+        }
+
+        ServerConfig next = base;
+        std::string line;
+        int lineno = 0;
+        while (std::getline(in, line))
+        {
+            lineno++;
+            size_t hash = line.find('#');
+            if (hash != std::string::npos)
+                line.resize(hash);
+            line = trim(line);
+            if (line.empty())
+                continue;
+
+            size_t eq = line.find('=');
+            std::string key = trim(line.substr(0, eq));
+            std::string value = eq == std::string::npos ? std::string() : trim(line.substr(eq + 1));
+            if (eq == std::string::npos || key.empty() || value.empty())
+            {
+                error = "第" + std::to_string(lineno) + "行格式错误：" + line;
+                return false;
+            }
+
+            // 数值超出范围和非数字都按格式错误处理
+            bool ok = true;
+            try
+            {
+                size_t used = 0;
+                if (key == "data_threads")
+                {
+                    unsigned long v = std::stoul(value, &used);
+                    ok = v >= 1 && v <= max_config_threads;
+                    next.data_threads = v;
+                }
+                else if (key == "queue_limit")
+                    next.queue_limit = std::stoul(value, &used);
+                else if (key == "recv_buffer" || key == "send_buffer")
+                {
+                    long v = std::stol(value, &used);
+                    ok = v >= 0 && v <= max_config_buffer;
+                    (key == "recv_buffer" ? next.recv_buffer : next.send_buffer) = static_cast<int>(v);
+                }
+                else if (key == "send_batch")
+                {
+                    unsigned long v = std::stoul(value, &used);
+                    ok = v >= 1 && v <= max_send_batch;
+                    next.send_batch = v;
+                }
+                else if (key == "log_level")
+                {
+                    ok = name2level(value, next.log_level);
+                    used = value.size();
+                }
+                else if (key == "log_sink")
+                {
+                    ok = value == "console" || value == "file" || value == "binary";
+                    next.log_sink = value;
+                    used = value.size();
+                }
+                else
+                {
+                    LOG(LogLevel::WARNING) << "忽略未知配置项：" << key << " 行：" << lineno;
+                    used = value.size();
+                }
+                ok = ok && used == value.size();
+            }
+            catch (const std::exception &)
+            {
+                ok = false;
+            }
+
+            if (!ok)
+            {
+                error = "第" + std::to_string(lineno) + "行取值无效：" + line;
+                return false;
+            }
+        }
+
+        config = next;
+        return true;
+    }
+
+    // 启动时加载配置文件，之后每次收到SIGHUP重新加载
+    // SIGHUP在所有线程中屏蔽，由重新加载线程同步等待，应用配置时不在信号处理函数中
+    class ConfigReloader
+    {
+    public:
+        // 应用配置变化，参数为当前配置和新配置，只需要处理不同的项
+        using apply_t = std::function<void(const ServerConfig &, const ServerConfig &)>;
+
+    private:
+        void run()
+        {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGHUP);
+            // 以100ms为单位等待，保证停止时能及时退出
+            struct timespec timeout = {0, 100 * 1000000};
+            while (_isRunning)
+            {
+                if (sigtimedwait(&set, NULL, &timeout) == SIGHUP)
+                {
+                    LOG(LogLevel::INFO) << "收到SIGHUP，重新加载配置：" << _path;
+                    reload();
+                }
+            }
+        }
+
+    public:
+        ConfigReloader(const std::string &path, const ServerConfig &base, size_t max_send_batch, apply_t apply)
+            : _path(path), _base(base), _current(base), _max_send_batch(max_send_batch), _apply(apply), _isRunning(false),
+              _thread([this]()
+                      { run(); })
+        {
+        }
+
+        // 在创建任何线程之前调用，之后创建的线程继承屏蔽字
+        static void blockSignal()
+        {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGHUP);
+            pthread_sigmask(SIG_BLOCK, &set, NULL);
+        }
+
+        // 读取配置文件并应用变化的项，文件有错误时保持当前配置
+        bool reload()
+        {
+            MutexGuard guard(_lock);
+            ServerConfig next;
+            std::string error;
+            if (!loadConfig(_path, _base, _max_send_batch, next, error))
+            {
+                LOG(LogLevel::ERROR) << "配置文件错误，保持当前配置：" << error;
+                return false;
+            }
+
+            _apply(_current, next);
+            _current = next;
+            LOG(LogLevel::INFO) << "生效配置：" << describeConfig(_current);
+            return true;
+        }
+
+        void start()
+        {
+            if (_isRunning)
+                return;
+            _isRunning = true;
+            _thread.start();
+        }
+
+        void stop()
+        {
+            if (!_isRunning)
+                return;
+            _isRunning = false;
+            _thread.join();
+        }
+
+        ~ConfigReloader()
+        {
+            stop();
+        }
+
+    private:
+        std::string _path;
+        ServerConfig _base;    // 启动参数决定的配置
+        ServerConfig _current; // 当前生效的配置
+        size_t _max_send_batch;
+        apply_t _apply;
+        Mutex _lock;
+        volatile bool _isRunning;
+        Thread _thread;
+    };
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <random>
+#include <cstring>
+#include <netinet/in.h>
+#include "protocol.hpp"
+#include "mutex.hpp"
+
+namespace CookieModule
+{
+    using namespace ProtocolModule;
+    using namespace MutexModule;
+
+    // 上线握手：客户端发送"名字:online"后服务器不分配任何状态，只回复一个与源地址绑定的cookie
+    // 挑战：[magic][C][周期低8位 1B][MAC 8B]
+    // 回复：[magic][C][周期低8位 1B][MAC 8B]["名字:online"]
+    // 加入组播和请求可靠投递：[magic][C][周期低8位 1B][MAC 8B][magic][M或H]，同样需要源地址能收到挑战
+    // MAC = SipHash-2-4(周期密钥, IPv4 + 端口 + 周期号)，只有能收到挑战的地址才能完成上线
+    // 密钥每个周期随机生成一次，验证时接受当前周期和上一个周期，cookie有效期为1到2个周期
+    const size_t cookie_size = 9;
+    const size_t cookie_frame_size = frame_head_size + cookie_size;
+
+    const uint64_t d_cookie_period_ms = 30000; // 密钥轮换周期
+    const size_t cookie_slots = 4;             // 保存的周期密钥个数，只用到最近两个，其余留给正在读取的线程
+
+    inline uint64_t rotl64(uint64_t x, int b)
+    {
+        return (x << b) | (x >> (64 - b));
+    }
+
+    // SipHash-2-4，输入按小端序读取
+    inline uint64_t siphash(uint64_t k0, uint64_t k1, const uint8_t *in, size_t len)
+    {
+        uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+        uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+        uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+        uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+        auto round = [&]()
+        {
+            v0 += v1; v1 = rotl64(v1, 13); v1 ^= v0; v0 = rotl64(v0, 32);
+            v2 += v3; v3 = rotl64(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = rotl64(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = rotl64(v1, 17); v1 ^= v2; v2 = rotl64(v2, 32);
+        };
+
+        size_t end = len - len % 8;
+        for (size_t i = 0; i < end; i += 8)
+        {
+            uint64_t m = 0;
+            for (int j = 0; j < 8; j++)
+                m |= static_cast<uint64_t>(in[i + j]) << (8 * j);
+            v3 ^= m;
+            round();
+            round();
+            v0 ^= m;
+        }
+
+        uint64_t b = static_cast<uint64_t>(len) << 56;
+        for (size_t j = 0; j < len % 8; j++)
+            b |= static_cast<uint64_t>(in[end + j]) << (8 * j);
+        v3 ^= b;
+        round();
+        round();
+        v0 ^= b;
+
+        v2 ^= 0xff;
+        for (int r = 0; r < 4; r++)
+            round();
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+
+    // 客户端收到挑战后构造上线回复，挑战格式不对时返回空串
+    inline std::string cookieResponse(const char *challenge, size_t len, const std::string &payload)
+    {
+        if (len != cookie_frame_size || !isFrame(challenge, len, FrameType::Cookie))
+            return std::string();
+        std::string frame(challenge, cookie_frame_size);
+        frame += payload;
+        return frame;
+    }
+
+    // 服务器端的cookie生成和验证，不保存任何客户端状态，可以在多个接收线程中同时使用
+    class CookieJar
+    {
+    private:
+        // 一个周期的密钥，按顺序锁的方式更新：先把周期号置为无效，写入密钥后再发布周期号
+        struct Secret
+        {
+            std::atomic<uint64_t> period{UINT64_MAX};
+            std::atomic<uint64_t> k0{0};
+            std::atomic<uint64_t> k1{0};
+        };
+
+        // 读取周期密钥，create为true时周期密钥不存在则生成，读取期间密钥被替换时返回false
+        bool secret(uint64_t period, uint64_t &k0, uint64_t &k1, bool create)
+        {
+            Secret &s = _secrets[period % cookie_slots];
+            if (s.period.load(std::memory_order_acquire) != period)
+            {
+                if (!create)
+                    return false;
+
+                MutexGuard guard(_lock);
+                if (s.period.load(std::memory_order_relaxed) != period)
+                {
+                    s.period.store(UINT64_MAX, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    s.k0.store(randomKey(), std::memory_order_relaxed);
+                    s.k1.store(randomKey(), std::memory_order_relaxed);
+                    s.period.store(period, std::memory_order_release);
+                }
+            }
+
+            k0 = s.k0.load(std::memory_order_relaxed);
+            k1 = s.k1.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return s.period.load(std::memory_order_relaxed) == period;
+        }
+
+        // 密钥直接取自系统随机源，每个周期只取一次
+        static uint64_t randomKey()
+        {
+            std::random_device rd;
+            return (static_cast<uint64_t>(rd()) << 32) | rd();
+        }
+
+        static uint64_t mac(uint64_t k0, uint64_t k1, const struct sockaddr_in &peer, uint64_t period)
+        {
+            uint8_t in[14];
+            memcpy(in, &peer.sin_addr.s_addr, 4);
+            memcpy(in + 4, &peer.sin_port, 2);
+            for (int i = 0; i < 8; i++)
+                in[6 + i] = static_cast<uint8_t>(period >> (8 * i));
+            return siphash(k0, k1, in, sizeof(in));
+        }
+
+    public:
+        CookieJar(uint64_t period_ms = d_cookie_period_ms)
+            : _period_ms(period_ms)
+        {
+        }
+
+        CookieJar(const CookieJar &) = delete;
+        CookieJar &operator=(const CookieJar &) = delete;
+
+        // 生成发给peer的挑战帧
+        std::string challenge(const struct sockaddr_in &peer)
+        {
+            uint64_t period = nowMs() / _period_ms;
+            uint64_t k0 = 0, k1 = 0;
+            while (!secret(period, k0, k1, true))
+                ;
+
+            std::string frame;
+            frame.reserve(cookie_frame_size);
+            putFrameHead(frame, FrameType::Cookie);
+            frame.push_back(static_cast<char>(period & 0xff));
+            uint64_t value = mac(k0, k1, peer, period);
+            putU32(frame, static_cast<uint32_t>(value >> 32));
+            putU32(frame, static_cast<uint32_t>(value));
+            return frame;
+        }
+
+        // 验证回复帧，通过时payload指向帧中携带的消息
+        bool verify(const char *data, size_t len, const struct sockaddr_in &peer, const char *&payload, size_t &payload_len)
+        {
+            if (len <= cookie_frame_size || !isFrame(data, len, FrameType::Cookie))
+                return false;
+
+            // 周期号只带低8位，从当前周期和上一个周期中找出对应的一个
+            uint64_t now = nowMs() / _period_ms;
+            uint8_t low = static_cast<uint8_t>(data[frame_head_size]);
+            uint64_t period = 0;
+            if ((now & 0xff) == low)
+                period = now;
+            else if (now > 0 && ((now - 1) & 0xff) == low)
+                period = now - 1;
+            else
+                return false;
+
+            uint64_t k0 = 0, k1 = 0;
+            if (!secret(period, k0, k1, false))
+                return false;
+
+            const char *p = data + frame_head_size + 1;
+            uint64_t expect = mac(k0, k1, peer, period);
+            uint64_t got = (static_cast<uint64_t>(getU32(p)) << 32) | getU32(p + 4);
+            if (expect != got)
+                return false;
+
+            payload = data + cookie_frame_size;
+            payload_len = len - cookie_frame_size;
+            return true;
+        }
+
+    private:
+        uint64_t _period_ms;
+        Mutex _lock; // 只在生成新周期的密钥时持有
+        Secret _secrets[cookie_slots];
+    };
+}
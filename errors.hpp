@@ -5,4 +5,5 @@ enum class ErrorNumber
 {
     SocketFail = 1, // 创建套接字失败
     BindSocketFail, // 绑定失败
+    OpenLogFail,    // 打开日志文件失败
 };
\ No newline at end of file
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <time.h>
+#include <sys/uio.h>
+#include "sockaddr_in_t.hpp"
+#include "protocol.hpp"
+#include "fragment.hpp"
+#include "mutex.hpp"
+#include "log.hpp"
+
+namespace FederationModule
+{
+    using namespace SockAddrInModule;
+    using namespace ProtocolModule;
+    using namespace FragmentModule;
+    using namespace MutexModule;
+    using namespace LogSystemModule;
+
+    // 去重窗口大小，保存最近收到的消息ID
+    const size_t d_dedup_capacity = 65536;
+
+    // 转发帧格式：[0x02]['F'][源节点ID 4B][源节点启动时间 4B][序号 4B][消息]
+    const size_t federation_head_size = frame_head_size + 12;
+
+    // 消息ID：源节点 + 启动时间 + 序号，节点重启后序号重新计数也不会被误判为重复
+    struct MessageId
+    {
+        uint32_t node;
+        uint32_t epoch;
+        uint32_t seq;
+
+        bool operator==(const MessageId &id) const
+        {
+            return node == id.node && epoch == id.epoch && seq == id.seq;
+        }
+    };
+
+    struct MessageIdHash
+    {
+        size_t operator()(const MessageId &id) const
+        {
+            uint64_t key = (static_cast<uint64_t>(id.node) << 32) ^ (static_cast<uint64_t>(id.epoch) << 16) ^ id.seq;
+            return std::hash<uint64_t>()(key);
+        }
+    };
+
+    class Federation
+    {
+    private:
+        // 判断消息是否已经收到过，没有收到过时记录下来
+        bool isDuplicate(const MessageId &id)
+        {
+            MutexGuard guard(_dedup_lock);
+            if (_seen.count(id))
+                return true;
+
+            _seen.insert(id);
+            _order.push_back(id);
+            // 超出窗口时淘汰最早的ID
+            if (_order.size() > _capacity)
+            {
+                _seen.erase(_order.front());
+                _order.pop_front();
+            }
+            return false;
+        }
+
+        // 帧头、前缀和消息作为三段iovec发送
+        void sendFrame(int sockfd, SockAddrIn &peer, const char *head, size_t head_len,
+                       const char *prefix, size_t prefix_len, const char *message, size_t message_len)
+        {
+            struct iovec iov[3];
+            iov[0].iov_base = const_cast<char *>(head);
+            iov[0].iov_len = head_len;
+            iov[1].iov_base = const_cast<char *>(prefix);
+            iov[1].iov_len = prefix_len;
+            iov[2].iov_base = const_cast<char *>(message);
+            iov[2].iov_len = message_len;
+
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &peer;
+            hdr.msg_namelen = peer.getLength();
+            hdr.msg_iov = iov;
+            hdr.msg_iovlen = 3;
+
+            if (sendmsg(sockfd, &hdr, 0) < 0)
+                LOG(LogLevel::WARNING) << "转发到节点失败：" << peer.getIp() << ":" << peer.getPort() << " " << strerror(errno);
+        }
+
+    public:
+        Federation(uint32_t node_id, const std::vector<SockAddrIn> &peers, size_t capacity = d_dedup_capacity)
+            : _node_id(node_id), _epoch(static_cast<uint32_t>(time(NULL))), _seq(0), _peers(peers), _capacity(capacity)
+        {
+            for (auto &peer : _peers)
+                LOG(LogLevel::INFO) << "节点" << _node_id << "添加对等节点：" << peer.getIp() << ":" << peer.getPort();
+        }
+
+        // 解析"ip:port,ip:port"格式的对等节点列表
+        static std::vector<SockAddrIn> parsePeers(const std::string &list)
+        {
+            std::vector<SockAddrIn> peers;
+            size_t start = 0;
+            while (start < list.size())
+            {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos)
+                    end = list.size();
+
+                std::string item = list.substr(start, end - start);
+                size_t colon = item.rfind(':');
+                if (colon != std::string::npos)
+                    peers.emplace_back(static_cast<uint16_t>(std::stoi(item.substr(colon + 1))), item.substr(0, colon));
+                else if (!item.empty())
+                    LOG(LogLevel::WARNING) << "无效的对等节点：" << item;
+
+                start = end + 1;
+            }
+            return peers;
+        }
+
+        // 将本节点收到的消息转发给所有对等节点，每条消息只转发一次
+        void forward(int sockfd, const std::string &prefix, std::string_view message)
+        {
+            if (_peers.empty())
+                return;
+
+            uint32_t seq = 0;
+            {
+                MutexGuard guard(_seq_lock);
+                seq = ++_seq;
+            }
+
+            std::string head;
+            head.reserve(federation_head_size);
+            putFrameHead(head, FrameType::Federation);
+            putU32(head, _node_id);
+            putU32(head, _epoch);
+            putU32(head, seq);
+
+            // 超长时将整个转发帧分片，对端重组后再按转发帧处理
+            if (_fragmenter.needSplit(head.size() + prefix.size() + message.size()))
+            {
+                std::string whole = head + prefix;
+                whole.append(message.data(), message.size());
+                std::vector<std::string> frames = _fragmenter.split(whole);
+                for (auto &peer : _peers)
+                    for (auto &f : frames)
+                        sendFrame(sockfd, peer, f.data(), f.size(), NULL, 0, NULL, 0);
+                return;
+            }
+
+            for (auto &peer : _peers)
+                sendFrame(sockfd, peer, head.data(), head.size(), prefix.data(), prefix.size(), message.data(), message.size());
+        }
+
+        // 处理对等节点转发过来的帧，需要投递给本地用户时返回true并设置message
+        bool accept(const char *data, size_t len, const struct sockaddr_in &from, std::string &message)
+        {
+            if (len < federation_head_size)
+                return false;
+
+            // 只接受配置中的对等节点发来的帧
+            SockAddrIn sender(from);
+            bool known = false;
+            for (auto &peer : _peers)
+                if (peer == sender)
+                {
+                    known = true;
+                    break;
+                }
+            if (!known)
+            {
+                LOG(LogLevel::WARNING) << "丢弃未知节点的转发帧：" << sender.getIp() << ":" << sender.getPort();
+                return false;
+            }
+
+            MessageId id;
+            id.node = getU32(data + frame_head_size);
+            id.epoch = getU32(data + frame_head_size + 4);
+            id.seq = getU32(data + frame_head_size + 8);
+
+            // 自己发出的消息或者重复消息不再投递
+            if (id.node == _node_id || isDuplicate(id))
+                return false;
+
+            message.assign(data + federation_head_size, len - federation_head_size);
+            return true;
+        }
+
+        uint32_t getNodeId()
+        {
+            return _node_id;
+        }
+
+    private:
+        uint32_t _node_id;              // 本节点ID，集群内唯一
+        uint32_t _epoch;                // 本节点启动时间
+        uint32_t _seq;                  // 转发消息序号
+        Mutex _seq_lock;                // 序号锁
+        std::vector<SockAddrIn> _peers; // 静态对等节点列表
+        Fragmenter _fragmenter;         // 超长转发帧分片
+
+        std::unordered_set<MessageId, MessageIdHash> _seen; // 已收到的消息ID
+        std::deque<MessageId> _order;                       // 按到达顺序记录的消息ID，用于淘汰
+        size_t _capacity;                                   // 去重窗口大小
+        Mutex _dedup_lock;                                  // 去重锁
+    };
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <random>
+#include <time.h>
+#include <netinet/in.h>
+#include "protocol.hpp"
+#include "log.hpp"
+
+namespace FragmentModule
+{
+    using namespace ProtocolModule;
+    using namespace LogSystemModule;
+
+    const size_t d_max_datagram = 65536;      // 接收缓冲区大小，不小于UDP最大报文
+    const size_t d_fragment_size = 1200;      // 单个分片的数据长度，超过时分片发送
+    const size_t d_max_message = 64 * 1024;   // 默认允许的最大消息长度
+    const size_t d_max_overhead = 512;        // 转发时附加的发送者前缀和帧头的余量
+    const size_t d_reassembly_buffers = 64;   // 重组缓冲区总数，限制重组占用的内存
+    const size_t d_partials_per_source = 4;   // 每个来源同时重组的消息数
+    const int d_reassembly_timeout_ms = 2000; // 未完成的消息超时丢弃
+
+    // 分片帧：[0x02]['G'][消息ID 4B][分片序号 2B][分片总数 2B][消息总长 4B][数据]
+    const size_t fragment_head_size = frame_head_size + 12;
+
+    // 发送端：将超长消息切分为分片帧
+    class Fragmenter
+    {
+    public:
+        Fragmenter(size_t fragment_size = d_fragment_size)
+            : _fragment_size(fragment_size), _next_id(std::random_device()())
+        {
+        }
+
+        // 是否需要分片
+        bool needSplit(size_t len)
+        {
+            return len > _fragment_size;
+        }
+
+        // 切分消息，每个分片帧都可以单独发送
+        std::vector<std::string> split(std::string_view message)
+        {
+            std::vector<std::string> frames;
+            uint32_t id = _next_id++;
+            size_t count = (message.size() + _fragment_size - 1) / _fragment_size;
+            frames.reserve(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t off = i * _fragment_size;
+                size_t len = std::min(_fragment_size, message.size() - off);
+
+                std::string frame;
+                frame.reserve(fragment_head_size + len);
+                putFrameHead(frame, FrameType::Fragment);
+                putU32(frame, id);
+                putU16(frame, static_cast<uint16_t>(i));
+                putU16(frame, static_cast<uint16_t>(count));
+                putU32(frame, static_cast<uint32_t>(message.size()));
+                frame.append(message.data() + off, len);
+                frames.push_back(std::move(frame));
+            }
+            return frames;
+        }
+
+        size_t getFragmentSize()
+        {
+            return _fragment_size;
+        }
+
+    private:
+        size_t _fragment_size;
+        std::atomic<uint32_t> _next_id; // 消息ID，随机起始避免重启后与旧分片混淆
+    };
+
+    // 固定大小的重组缓冲区池，缓冲区按需创建，总数有上限
+    class BufferPool
+    {
+    public:
+        BufferPool(size_t buffer_size, size_t capacity)
+            : _buffer_size(buffer_size), _capacity(capacity), _created(0)
+        {
+        }
+
+        // 没有可用缓冲区时返回nullptr
+        char *acquire()
+        {
+            if (!_free.empty())
+            {
+                char *buffer = _free.back();
+                _free.pop_back();
+                return buffer;
+            }
+
+            if (_created >= _capacity)
+                return nullptr;
+
+            _buffers.push_back(std::make_unique<char[]>(_buffer_size));
+            _created++;
+            return _buffers.back().get();
+        }
+
+        void release(char *buffer)
+        {
+            _free.push_back(buffer);
+        }
+
+        size_t getBufferSize()
+        {
+            return _buffer_size;
+        }
+
+    private:
+        size_t _buffer_size;
+        size_t _capacity;
+        size_t _created;
+        std::vector<std::unique_ptr<char[]>> _buffers; // 所有创建过的缓冲区
+        std::vector<char *> _free;                     // 空闲缓冲区
+    };
+
+    // 未完成消息的键：来源地址 + 发送端的消息ID，两者都完整比较，不同来源的消息不会冲突
+    struct PartialKey
+    {
+        uint64_t source;
+        uint32_t id;
+
+        bool operator==(const PartialKey &key) const
+        {
+            return source == key.source && id == key.id;
+        }
+    };
+
+    struct PartialKeyHash
+    {
+        size_t operator()(const PartialKey &key) const
+        {
+            size_t h = std::hash<uint64_t>()(key.source);
+            return h ^ (std::hash<uint32_t>()(key.id) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+        }
+    };
+
+    // 接收端：乱序重组分片，只在单个接收线程中使用
+    class Reassembler
+    {
+    private:
+        struct Partial
+        {
+            uint64_t source;
+            uint32_t id;
+            uint64_t created_ms;
+            char *buffer;
+            uint32_t total_len;
+            uint16_t count;
+            uint16_t received;
+            std::vector<bool> got;
+        };
+
+        using partial_list = std::list<Partial>;
+
+        void drop(partial_list::iterator it)
+        {
+            _pool.release(it->buffer);
+            _index.erase(PartialKey{it->source, it->id});
+            auto count = _per_source.find(it->source);
+            if (count != _per_source.end() && --count->second == 0)
+                _per_source.erase(count);
+            _partials.erase(it);
+        }
+
+        // 丢弃超时的消息，链表按创建时间排列
+        void expire(uint64_t now)
+        {
+            while (!_partials.empty() && now - _partials.front().created_ms >= static_cast<uint64_t>(_timeout_ms))
+            {
+                drop(_partials.begin());
+                _timeouts++;
+            }
+        }
+
+    public:
+        Reassembler(size_t max_message = d_max_message, size_t fragment_size = d_fragment_size,
+                    size_t buffers = d_reassembly_buffers, size_t per_source = d_partials_per_source, int timeout_ms = d_reassembly_timeout_ms)
+            : _max_message(max_message), _fragment_size(fragment_size), _per_source_limit(per_source), _timeout_ms(timeout_ms),
+              _pool(max_message, buffers), _completed(0), _timeouts(0), _rejected(0)
+        {
+        }
+
+        // 处理一个分片帧，消息完整时返回true并设置message
+        bool onFragment(const char *data, size_t len, const struct sockaddr_in &from, std::string &message)
+        {
+            uint64_t now = nowMs();
+            expire(now);
+
+            if (len < fragment_head_size)
+                return false;
+
+            uint32_t id = getU32(data + frame_head_size);
+            uint16_t index = getU16(data + frame_head_size + 4);
+            uint16_t count = getU16(data + frame_head_size + 6);
+            uint32_t total_len = getU32(data + frame_head_size + 8);
+            const char *payload = data + fragment_head_size;
+            size_t payload_len = len - fragment_head_size;
+
+            // 校验分片是否与约定的分片大小一致
+            size_t expect_count = (total_len + _fragment_size - 1) / _fragment_size;
+            size_t expect_len = index + 1 < count ? _fragment_size : total_len - static_cast<size_t>(index) * _fragment_size;
+            if (total_len == 0 || total_len > _max_message || count != expect_count || index >= count || payload_len != expect_len)
+            {
+                _rejected++;
+                return false;
+            }
+
+            uint64_t source = addrKey(from);
+            auto found = _index.find(PartialKey{source, id});
+            partial_list::iterator it;
+            if (found == _index.end())
+            {
+                // 限制单个来源同时重组的消息数
+                if (_per_source[source] >= _per_source_limit)
+                {
+                    _rejected++;
+                    return false;
+                }
+
+                char *buffer = _pool.acquire();
+                // 缓冲区用完时淘汰最早的未完成消息
+                if (!buffer && !_partials.empty())
+                {
+                    drop(_partials.begin());
+                    _timeouts++;
+                    buffer = _pool.acquire();
+                }
+                if (!buffer)
+                {
+                    _rejected++;
+                    return false;
+                }
+
+                _partials.push_back(Partial{source, id, now, buffer, total_len, count, 0, std::vector<bool>(count, false)});
+                it = std::prev(_partials.end());
+                _index[PartialKey{source, id}] = it;
+                _per_source[source]++;
+            }
+            else
+            {
+                it = found->second;
+                if (it->total_len != total_len || it->count != count)
+                {
+                    _rejected++;
+                    return false;
+                }
+            }
+
+            if (it->got[index])
+                return false;
+
+            memcpy(it->buffer + static_cast<size_t>(index) * _fragment_size, payload, payload_len);
+            it->got[index] = true;
+            it->received++;
+
+            if (it->received < it->count)
+                return false;
+
+            message.assign(it->buffer, it->total_len);
+            drop(it);
+            _completed++;
+            return true;
+        }
+
+        void printStats()
+        {
+            LOG(LogLevel::INFO) << "分片重组统计 完成：" << _completed << " 超时/淘汰：" << _timeouts << " 拒绝：" << _rejected;
+        }
+
+    private:
+        size_t _max_message;
+        size_t _fragment_size;
+        size_t _per_source_limit;
+        int _timeout_ms;
+        BufferPool _pool;
+
+        partial_list _partials;                                    // 按创建时间排列的未完成消息
+        std::unordered_map<PartialKey, partial_list::iterator, PartialKeyHash> _index; // 来源+消息ID -> 未完成消息
+        std::unordered_map<uint64_t, size_t> _per_source;            // 每个来源的未完成消息数
+
+        uint64_t _completed;
+        uint64_t _timeouts;
+        uint64_t _rejected;
+    };
+}
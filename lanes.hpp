@@ -0,0 +1,162 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <time.h>
+#include "ThreadPool.hpp"
+#include "log.hpp"
+
+namespace LaneModule
+{
+    using namespace ThreadPoolModule;
+    using namespace LogSystemModule;
+
+    // 任务通道编号，不同通道使用不同的线程池，互不阻塞
+    const int control_lane = 0; // 上线、下线等成员变更，单线程保证顺序
+    const int data_lane = 1;    // 聊天消息的分发
+
+    const int d_control_threads = 1;
+    const int d_data_threads = d_num;
+
+    inline uint64_t laneNowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 任务从入队到开始执行的排队时间统计，按2的幂分桶估算分位数
+    class LaneStats
+    {
+    private:
+        static const int buckets = 64;
+
+    public:
+        LaneStats()
+            : _count(0), _sum_ns(0), _max_ns(0)
+        {
+            for (auto &b : _hist)
+                b = 0;
+        }
+
+        void record(uint64_t ns)
+        {
+            _count.fetch_add(1, std::memory_order_relaxed);
+            _sum_ns.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t max = _max_ns.load(std::memory_order_relaxed);
+            while (ns > max && !_max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+                ;
+            int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+            _hist[b < buckets ? b : buckets - 1].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // 返回分位数所在桶的上界
+        uint64_t percentile(double p)
+        {
+            uint64_t count = _count.load(std::memory_order_relaxed);
+            if (count == 0)
+                return 0;
+            uint64_t target = static_cast<uint64_t>(p * count);
+            uint64_t seen = 0;
+            for (int b = 0; b < buckets; b++)
+            {
+                seen += _hist[b].load(std::memory_order_relaxed);
+                if (seen > target)
+                    return std::min<uint64_t>(b == 0 ? 0 : (1ULL << b) - 1, _max_ns);
+            }
+            return _max_ns;
+        }
+
+        void printStats(const std::string &name)
+        {
+            uint64_t count = _count;
+            LOG(LogLevel::INFO) << name << "通道排队延迟(us) 任务数：" << count
+                                << " 平均：" << (count ? _sum_ns / count / 1000.0 : 0)
+                                << " p50<=" << percentile(0.5) / 1000.0 << " p99<=" << percentile(0.99) / 1000.0
+                                << " 最大：" << _max_ns / 1000.0;
+        }
+
+    private:
+        std::atomic<uint64_t> _count;
+        std::atomic<uint64_t> _sum_ns;
+        std::atomic<uint64_t> _max_ns;
+        std::atomic<uint64_t> _hist[buckets];
+    };
+
+    // 带入队时间的任务，模板参数区分线程池单例
+    template <int Lane>
+    struct LaneTask
+    {
+        std::function<void()> func;
+        uint64_t enqueued_ns = 0;
+        LaneStats *stats = nullptr;
+
+        void operator()()
+        {
+            if (stats)
+                stats->record(laneNowNs() - enqueued_ns);
+            func();
+        }
+    };
+
+    // 一条任务通道：独立的线程池和排队统计
+    template <int Lane>
+    class TaskLane
+    {
+    public:
+        TaskLane(const std::string &name, int threads)
+            : _name(name), _threads(threads), _tp(ThreadPool<LaneTask<Lane>>::getInstance(threads))
+        {
+        }
+
+        bool start()
+        {
+            if (!_tp)
+                return false;
+            _tp->startThreads();
+            return true;
+        }
+
+        // 按排队延迟在[当前线程数, max_threads]之间调整线程数
+        void enableAdaptive(size_t max_threads, uint64_t target_us = d_adapt_target_us)
+        {
+            if (_tp)
+                _tp->enableAdaptive(_threads, max_threads, target_us);
+        }
+
+        // 运行时调整线程数，自适应模式下调整最少线程数
+        void setThreads(size_t threads)
+        {
+            _threads = threads;
+            if (_tp)
+                _tp->setThreads(threads);
+        }
+
+        void push(std::function<void()> func)
+        {
+            LaneTask<Lane> task{std::move(func), laneNowNs(), &_stats};
+            _tp->pushTasks(task);
+        }
+
+        // 执行完已入队的任务后回收线程
+        void stop()
+        {
+            if (!_tp)
+                return;
+            _tp->stopThreads();
+            _tp->waitThreads();
+            _tp.reset();
+            _stats.printStats(_name);
+        }
+
+    private:
+        std::string _name;
+        size_t _threads;
+        std::shared_ptr<ThreadPool<LaneTask<Lane>>> _tp;
+        LaneStats _stats;
+    };
+}
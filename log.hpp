@@ -7,15 +7,31 @@
 #include <unistd.h>
 #include <filesystem>
 #include <time.h>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "mutex.hpp"
+#include "binlog.hpp"
 
 namespace LogSystemModule
 {
     using namespace MutexModule;
+    using namespace BinaryLogModule;
 
     // 默认的目录路径和文件路径
     const std::string d_dir_path = "./log/";
     const std::string d_file_path = "log.txt";
+    const std::string d_binary_file_path = "log.bin";
+
+    // 文件日志的默认段大小、轮转时间、保留文件数和写回间隔
+    const size_t d_segment_size = 64 * 1024 * 1024;
+    const int d_rotate_seconds = 24 * 3600;
+    const size_t d_retain_files = 8;
+    const int d_sync_ms = 1000;
+    const int d_reopen_ms = 1000; // 打开文件段失败后重试的最短间隔
 
     // 日志等级
     enum class LogLevel
@@ -102,19 +118,144 @@ namespace LogSystemModule
     };
 
     // 具体策略类——文件输出
+    // 日志写入预先分配并映射到内存的文件段，写满或者超过轮转时间后轮转：
+    // log.txt -> log.txt.1 -> log.txt.2 ...，只保留retain个旧文件
     class FileLogStrategy : public LogStrategy
     {
+    private:
+        static uint64_t coarseMs()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+        }
+
+        // 打开当前文件段，已有内容时在末尾继续写入，调用方持有_lock
+        bool openSegment()
+        {
+            const std::string path = _dir_path + _file_path;
+            _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (_fd < 0)
+            {
+                std::cerr << "open log file failed: " << path << " " << strerror(errno) << std::endl;
+                return false;
+            }
+
+            struct stat st;
+            fstat(_fd, &st);
+            _offset = static_cast<size_t>(st.st_size);
+
+            // 已有文件超过段大小(例如段大小被调小)时无法整体映射，先把它移到旧文件中
+            if (_offset > _segment_size)
+            {
+                ::close(_fd);
+                shiftFiles();
+                _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (_fd < 0)
+                {
+                    std::cerr << "open log file failed: " << path << " " << strerror(errno) << std::endl;
+                    return false;
+                }
+                _offset = 0;
+            }
+
+            // 预先分配整个文件段，写入时不再扩展文件
+            int err = posix_fallocate(_fd, 0, _segment_size);
+            if (err != 0 && ftruncate(_fd, _segment_size) < 0)
+            {
+                std::cerr << "allocate log file failed: " << strerror(err) << std::endl;
+                ::close(_fd);
+                _fd = -1;
+                return false;
+            }
+
+            void *map = mmap(NULL, _segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+            if (map == MAP_FAILED)
+            {
+                std::cerr << "mmap log file failed: " << strerror(errno) << std::endl;
+                ::close(_fd);
+                _fd = -1;
+                return false;
+            }
+            _map = static_cast<char *>(map);
+
+            // 上次异常退出时文件没有截断，去掉末尾预分配的空白
+            while (_offset > 0 && _map[_offset - 1] == '\0')
+                _offset--;
+
+            _opened_ms = coarseMs();
+            _synced_ms = _opened_ms;
+            _synced_offset = _offset;
+            return true;
+        }
+
+        // 同步并截断到实际写入的长度，调用方持有_lock
+        void closeSegment()
+        {
+            if (_fd < 0)
+                return;
+
+            msync(_map, _segment_size, MS_SYNC);
+            munmap(_map, _segment_size);
+            if (ftruncate(_fd, _offset) < 0)
+                std::cerr << "truncate log file failed: " << strerror(errno) << std::endl;
+            ::close(_fd);
+            _fd = -1;
+            _map = nullptr;
+            _offset = 0;
+        }
+
+        // 依次后移旧文件，当前文件成为第一个旧文件，调用方持有_lock
+        void shiftFiles()
+        {
+            const std::string path = _dir_path + _file_path;
+            std::error_code ec;
+            std::filesystem::remove(path + "." + std::to_string(_retain), ec);
+            for (size_t i = _retain; i > 1; i--)
+                std::filesystem::rename(path + "." + std::to_string(i - 1), path + "." + std::to_string(i), ec);
+            if (_retain > 0)
+                std::filesystem::rename(path, path + ".1", ec);
+            else
+                std::filesystem::remove(path, ec);
+        }
+
+        // 关闭并后移当前文件段，再打开新的文件段，调用方持有_lock
+        void rotate()
+        {
+            closeSegment();
+            shiftFiles();
+            reopen(coarseMs());
+        }
+
+        // 打开文件段，失败时记录时间，之后按间隔重试，调用方持有_lock
+        void reopen(uint64_t now)
+        {
+            if (!openSegment())
+                _failed_ms = now;
+        }
+
+        // 将脏页异步写回，按配置的间隔执行而不是每行执行，调用方持有_lock
+        void sync()
+        {
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t begin = _synced_offset / page * page;
+            if (_offset > begin)
+                msync(_map + begin, _offset - begin, MS_ASYNC);
+            _synced_offset = _offset;
+        }
+
     public:
-        FileLogStrategy(const std::string &dir_path = d_dir_path, const std::string &file_path = d_file_path)
-            : _dir_path(dir_path), _file_path(file_path)
+        FileLogStrategy(const std::string &dir_path = d_dir_path, const std::string &file_path = d_file_path,
+                        size_t segment_size = d_segment_size, int rotate_seconds = d_rotate_seconds,
+                        size_t retain = d_retain_files, int sync_ms = d_sync_ms)
+            : _dir_path(dir_path), _file_path(file_path), _segment_size(segment_size), _rotate_ms(static_cast<uint64_t>(rotate_seconds) * 1000),
+              _retain(retain), _sync_ms(sync_ms), _fd(-1), _map(nullptr), _offset(0), _opened_ms(0), _synced_ms(0), _synced_offset(0), _failed_ms(0)
         {
             // 先申请锁
             MutexGuard guard(_lock);
 
             // 判断目录是否存在
-            if (std::filesystem::exists(_dir_path))
-                return; // 存在直接返回
-            else
+            if (!std::filesystem::exists(_dir_path))
             {
                 try
                 {
@@ -126,6 +267,8 @@ namespace LogSystemModule
                     std::cerr << e.what() << '\n';
                 }
             }
+
+            reopen(coarseMs());
         }
 
         virtual void printLog(const std::string &message) override
@@ -133,22 +276,56 @@ namespace LogSystemModule
             // 先申请锁
             MutexGuard guard(_lock);
 
-            // 打开文件并追加写入
-            const std::string path = _dir_path + _file_path;
-            std::fstream in_out(path, std::ios::app);
-            in_out << message << "\n";
+            uint64_t now = coarseMs();
+            // 单行超过整个文件段时截断
+            size_t len = std::min(message.size(), _segment_size - 1);
+            // 上次打开失败时没有可以后移的文件段，只按间隔重新打开，不丢弃保留的旧文件
+            if (_fd < 0)
+            {
+                if (now - _failed_ms < static_cast<uint64_t>(d_reopen_ms))
+                    return;
+                reopen(now);
+                if (_fd < 0)
+                    return;
+            }
+            if (_offset + len + 1 > _segment_size || (_rotate_ms > 0 && now - _opened_ms >= _rotate_ms))
+                rotate();
+            if (_fd < 0)
+                return;
 
-            // 关闭文件
-            in_out.close();
+            // 直接拷贝到映射的内存中
+            memcpy(_map + _offset, message.data(), len);
+            _map[_offset + len] = '\n';
+            _offset += len + 1;
+
+            if (now - _synced_ms >= static_cast<uint64_t>(_sync_ms))
+            {
+                _synced_ms = now;
+                sync();
+            }
         }
 
         ~FileLogStrategy()
         {
+            MutexGuard guard(_lock);
+            closeSegment();
         }
 
     private:
         std::string _dir_path;
         std::string _file_path;
+        size_t _segment_size; // 单个文件段大小
+        uint64_t _rotate_ms;  // 轮转时间，0表示只按大小轮转
+        size_t _retain;       // 保留的旧文件数
+        int _sync_ms;         // 写回间隔
+
+        int _fd;
+        char *_map;             // 当前文件段的映射
+        size_t _offset;         // 已写入的长度
+        uint64_t _opened_ms;    // 当前文件段的打开时间
+        uint64_t _synced_ms;    // 上次写回时间
+        size_t _synced_offset;  // 上次写回时的长度
+        uint64_t _failed_ms;    // 上次打开文件段失败的时间
 
         Mutex _lock;
     };
@@ -158,20 +335,83 @@ namespace LogSystemModule
     public:
         // 默认使用ConsoleLogStrategy类初始化
         LogHandler()
-            : _log(std::make_shared<ConsoleLogStrategy>())
+            : _log(std::make_shared<ConsoleLogStrategy>()), _min_level(static_cast<int>(LogLevel::DEBUG))
         {
         }
 
+        // 输出策略可以在运行时切换，正在输出的日志继续使用旧策略
         // 启用控制台输出
         void enableConsoleLog()
         {
-            _log = std::make_shared<ConsoleLogStrategy>();
+            setStrategy(std::make_shared<ConsoleLogStrategy>());
         }
 
         // 启用文件输出
-        void enableFileLog()
+        void enableFileLog(size_t segment_size = d_segment_size, int rotate_seconds = d_rotate_seconds,
+                           size_t retain = d_retain_files, int sync_ms = d_sync_ms)
         {
-            _log = std::make_shared<FileLogStrategy>();
+            setStrategy(std::make_shared<FileLogStrategy>(d_dir_path, d_file_path, segment_size, rotate_seconds, retain, sync_ms));
+        }
+
+        // 使用自定义的输出策略
+        void enableCustomLog(std::shared_ptr<LogStrategy> log)
+        {
+            setStrategy(log);
+        }
+
+        std::shared_ptr<LogStrategy> getStrategy()
+        {
+            MutexGuard guard(_log_lock);
+            return _log;
+        }
+
+        // 低于该等级的日志不格式化也不输出，可以在运行时修改
+        void setLevel(LogLevel level)
+        {
+            _min_level.store(static_cast<int>(level), std::memory_order_relaxed);
+        }
+
+        bool isEnabled(LogLevel level) const
+        {
+            return static_cast<int>(level) >= _min_level.load(std::memory_order_relaxed);
+        }
+
+        // 启用二进制日志，LOGB只记录调用点ID、时间戳和参数原始值，使用logdecode转换为文本
+        bool enableBinaryLog(const std::string &dir_path = d_dir_path, const std::string &file_path = d_binary_file_path)
+        {
+            try
+            {
+                std::filesystem::create_directories(dir_path);
+            }
+            catch (const std::filesystem::filesystem_error &e)
+            {
+                std::cerr << e.what() << '\n';
+            }
+            return _binlog.open(dir_path + file_path);
+        }
+
+        // 注册调用点，每个LOGB调用点只执行一次
+        uint32_t registerSite(LogLevel level, const std::string &filename, int lineno, const std::string &fmt)
+        {
+            return _binlog.registerSite(static_cast<int>(level), filename, lineno, fmt);
+        }
+
+        // 二进制模式下写入原始参数，否则展开格式串后按文本输出
+        template <class... Args>
+        void logFormat(uint32_t site, LogLevel level, const std::string &filename, int lineno, const std::string &fmt, const Args &...args)
+        {
+            if (_binlog.isOpen())
+            {
+                _binlog.write(site, args...);
+                return;
+            }
+
+            std::string encoded;
+            (encodeArg(encoded, args), ...);
+            size_t off = 0;
+            std::vector<std::string> values;
+            decodeArgs(encoded.data(), encoded.size(), sizeof...(args), off, values);
+            LogMessage(level, filename, lineno, *this) << formatMessage(fmt, values);
         }
 
         ~LogHandler()
@@ -208,8 +448,9 @@ namespace LogSystemModule
             ~LogMessage()
             {
                 // 如果父类引用不为空指针，就可以实现日志输出到指定为止
-                if (_loghandler._log)
-                    _loghandler._log->printLog(_message);
+                std::shared_ptr<LogStrategy> log = _loghandler.getStrategy();
+                if (log)
+                    log->printLog(_message);
             }
 
         private:
@@ -228,15 +469,37 @@ namespace LogSystemModule
         }
 
     private:
-        std::shared_ptr<LogStrategy>
-            _log;
+        void setStrategy(std::shared_ptr<LogStrategy> log)
+        {
+            MutexGuard guard(_log_lock);
+            _log = log;
+        }
+
+        std::shared_ptr<LogStrategy> _log;
+        Mutex _log_lock;               // 保护_log的切换
+        std::atomic<int> _min_level;   // 最低输出等级
+        BinaryLogWriter _binlog; // 二进制日志
     };
 
     // 创建LogHandler对象
     LogHandler loghandler;
 
-#define LOG(LEVEL) loghandler(LEVEL, __FILE__, __LINE__)
+// 等级低于最低等级时整条语句不执行，流插入的参数也不求值
+// 用只执行一次的for代替if，放在不带括号的if分支中也不会和外层的else配对
+#define LOG(LEVEL)                                                          \
+    for (bool _log_on = loghandler.isEnabled(LEVEL); _log_on; _log_on = false) \
+        loghandler(LEVEL, __FILE__, __LINE__)
+
+// 格式串中的{}依次替换为参数，参数支持整数、浮点数、字符串和sockaddr_in
+#define LOGB(LEVEL, FMT, ...)                                                                  \
+    do                                                                                         \
+    {                                                                                          \
+        static const uint32_t _log_site = loghandler.registerSite(LEVEL, __FILE__, __LINE__, FMT); \
+        if (loghandler.isEnabled(LEVEL))                                                       \
+            loghandler.logFormat(_log_site, LEVEL, __FILE__, __LINE__, FMT, ##__VA_ARGS__);  \
+    } while (0)
 
 #define ENABLECONSOLELOG() loghandler.enableConsoleLog()
 #define ENABLEFILELOG() loghandler.enableFileLog()
+#define ENABLEBINARYLOG() loghandler.enableBinaryLog()
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "log.hpp"
+#include "binlog.hpp"
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+using namespace LogSystemModule;
+using namespace BinaryLogModule;
+
+void usage(const char *proc)
+{
+    std::cerr << "错误使用，正确使用：" << proc << " 二进制日志文件..." << std::endl;
+}
+
+// 与getCurrentTime相同的时间格式
+std::string formatTime(uint64_t ns)
+{
+    time_t time_stamp = static_cast<time_t>(ns / 1000000000ULL);
+    struct tm time_struct;
+    localtime_r(&time_stamp, &time_struct);
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%4d-%02d-%02d %02d-%02d-%02d",
+             time_struct.tm_year + 1900, time_struct.tm_mon + 1, time_struct.tm_mday,
+             time_struct.tm_hour, time_struct.tm_min, time_struct.tm_sec);
+    return buffer;
+}
+
+// 将一个二进制日志文件转换为"[时间] [等级] [pid] [文件] [行号] - 消息"格式的文本
+bool decodeFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "打开文件失败：" << path << std::endl;
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const char *data = content.data();
+    size_t len = content.size();
+
+    if (len < 12 || memcmp(data, binlog_magic, sizeof(binlog_magic)) != 0 || getRaw<uint32_t>(data + 4) != binlog_version)
+    {
+        std::cerr << "不是二进制日志文件：" << path << std::endl;
+        return false;
+    }
+    uint32_t pid = getRaw<uint32_t>(data + 8);
+
+    std::unordered_map<uint32_t, CallSite> sites;
+    size_t off = 12;
+    while (off < len)
+    {
+        char tag = data[off];
+        if (tag == site_tag)
+        {
+            if (off + 8 > len)
+                break;
+            CallSite site;
+            site.id = getRaw<uint32_t>(data + off + 1);
+            site.level = static_cast<unsigned char>(data[off + 5]);
+            uint16_t file_len = getRaw<uint16_t>(data + off + 6);
+            size_t pos = off + 8;
+            if (pos + file_len + 6 > len)
+                break;
+            site.file.assign(data + pos, file_len);
+            pos += file_len;
+            site.line = getRaw<uint32_t>(data + pos);
+            uint16_t fmt_len = getRaw<uint16_t>(data + pos + 4);
+            pos += 6;
+            if (pos + fmt_len > len)
+                break;
+            site.fmt.assign(data + pos, fmt_len);
+            off = pos + fmt_len;
+            sites[site.id] = site;
+        }
+        else if (tag == event_tag)
+        {
+            if (off + 14 > len)
+                break;
+            uint32_t id = getRaw<uint32_t>(data + off + 1);
+            uint64_t ns = getRaw<uint64_t>(data + off + 5);
+            size_t argc = static_cast<unsigned char>(data[off + 13]);
+            size_t pos = off + 14;
+            std::vector<std::string> args;
+            if (!decodeArgs(data, len, argc, pos, args))
+                break;
+            off = pos;
+
+            auto it = sites.find(id);
+            if (it == sites.end())
+            {
+                std::cerr << "未知调用点：" << id << std::endl;
+                continue;
+            }
+            const CallSite &site = it->second;
+            std::cout << "[" << formatTime(ns) << "] "
+                      << "[" << level2string(static_cast<LogLevel>(site.level)) << "] "
+                      << "[" << pid << "] "
+                      << "[" << site.file << "] "
+                      << "[" << site.line << "] - "
+                      << formatMessage(site.fmt, args) << "\n";
+        }
+        else
+        {
+            std::cerr << "无效的记录类型，偏移：" << off << std::endl;
+            return false;
+        }
+    }
+
+    // 进程异常退出时最后一条记录可能不完整
+    if (off < len)
+        std::cerr << "文件末尾有不完整的记录：" << len - off << " 字节" << std::endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+
+    bool ok = true;
+    for (int i = 1; i < argc; i++)
+        ok = decodeFile(argv[i]) && ok;
+
+    return ok ? 0 : 1;
+}
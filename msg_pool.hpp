@@ -0,0 +1,243 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include "mutex.hpp"
+#include "log.hpp"
+
+namespace MessagePoolModule
+{
+    using namespace MutexModule;
+    using namespace LogSystemModule;
+
+    const size_t d_block_size = 2048;  // 每个消息块的数据容量，超过时单独申请
+    const size_t d_slab_blocks = 64;   // 全局空闲链表为空时一次申请的块数
+    const size_t d_local_cache = 128;  // 每个线程本地空闲链表的上限
+    const size_t d_refill_blocks = 32; // 本地空闲链表为空时一次从全局取出的块数
+
+    // 消息块头部，数据紧跟在头部之后
+    struct MessageBlock
+    {
+        std::atomic<uint32_t> refs; // 引用计数
+        uint32_t len;               // 数据长度
+        bool pooled;                // 是否来自池，超长消息单独申请
+
+        char *data()
+        {
+            return reinterpret_cast<char *>(this + 1);
+        }
+    };
+
+    // 固定大小消息块的池，线程本地空闲链表 + 全局空闲链表
+    // 接收线程申请、工作线程释放，本地链表超过上限时归还一半给全局链表
+    class MessagePool
+    {
+    private:
+        struct LocalCache
+        {
+            std::vector<MessageBlock *> blocks;
+
+            ~LocalCache()
+            {
+                // 线程退出时归还所有块
+                if (!blocks.empty())
+                    MessagePool::getInstance().giveBack(blocks, blocks.size());
+            }
+        };
+
+        static LocalCache &local()
+        {
+            static thread_local LocalCache cache;
+            return cache;
+        }
+
+        static size_t stride()
+        {
+            return sizeof(MessageBlock) + d_block_size;
+        }
+
+        // 将本地链表末尾的count个块归还给全局链表
+        void giveBack(std::vector<MessageBlock *> &blocks, size_t count)
+        {
+            MutexGuard guard(_lock);
+            _free.insert(_free.end(), blocks.end() - count, blocks.end());
+            blocks.resize(blocks.size() - count);
+        }
+
+        // 从全局链表取出一批块，全局链表为空时申请新的slab
+        void refill(std::vector<MessageBlock *> &blocks)
+        {
+            MutexGuard guard(_lock);
+            if (_free.empty())
+            {
+                _misses++;
+                _slabs.push_back(std::make_unique<char[]>(stride() * d_slab_blocks));
+                char *slab = _slabs.back().get();
+                for (size_t i = 0; i < d_slab_blocks; i++)
+                    _free.push_back(reinterpret_cast<MessageBlock *>(slab + i * stride()));
+            }
+
+            size_t count = std::min(d_refill_blocks, _free.size());
+            blocks.insert(blocks.end(), _free.end() - count, _free.end());
+            _free.resize(_free.size() - count);
+        }
+
+        MessagePool()
+            : _in_use(0), _high_water(0), _allocated(0), _misses(0), _oversize(0)
+        {
+        }
+
+    public:
+        MessagePool(const MessagePool &) = delete;
+        MessagePool &operator=(const MessagePool &) = delete;
+
+        static MessagePool &getInstance()
+        {
+            static MessagePool pool;
+            return pool;
+        }
+
+        // 申请一个消息块并拷贝数据，引用计数为1
+        MessageBlock *allocate(const char *data, size_t len)
+        {
+            MessageBlock *block = nullptr;
+            if (len > d_block_size)
+            {
+                _oversize++;
+                block = static_cast<MessageBlock *>(::operator new(sizeof(MessageBlock) + len));
+                new (block) MessageBlock;
+                block->pooled = false;
+            }
+            else
+            {
+                std::vector<MessageBlock *> &blocks = local().blocks;
+                if (blocks.empty())
+                    refill(blocks);
+                block = blocks.back();
+                blocks.pop_back();
+                new (block) MessageBlock;
+                block->pooled = true;
+            }
+
+            block->refs.store(1, std::memory_order_relaxed);
+            block->len = static_cast<uint32_t>(len);
+            memcpy(block->data(), data, len);
+
+            _allocated++;
+            uint64_t in_use = ++_in_use;
+            uint64_t high = _high_water.load(std::memory_order_relaxed);
+            while (in_use > high && !_high_water.compare_exchange_weak(high, in_use))
+                ;
+
+            return block;
+        }
+
+        // 引用计数减为0时回收
+        void release(MessageBlock *block)
+        {
+            if (block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            _in_use--;
+            if (!block->pooled)
+            {
+                block->~MessageBlock();
+                ::operator delete(block);
+                return;
+            }
+
+            block->~MessageBlock();
+            std::vector<MessageBlock *> &blocks = local().blocks;
+            blocks.push_back(block);
+            if (blocks.size() > d_local_cache)
+                giveBack(blocks, blocks.size() / 2);
+        }
+
+        uint64_t getHighWater()
+        {
+            return _high_water;
+        }
+
+        uint64_t getMisses()
+        {
+            return _misses;
+        }
+
+        void printStats()
+        {
+            size_t slabs = 0;
+            {
+                MutexGuard guard(_lock);
+                slabs = _slabs.size();
+            }
+            LOG(LogLevel::INFO) << "消息池统计 申请：" << _allocated << " 使用中：" << _in_use << " 峰值：" << _high_water
+                                << " 未命中(新建slab)：" << _misses << " 池容量：" << slabs * d_slab_blocks << " 超长：" << _oversize;
+        }
+
+    private:
+        Mutex _lock;
+        std::vector<MessageBlock *> _free;               // 全局空闲链表
+        std::vector<std::unique_ptr<char[]>> _slabs;     // 所有申请过的slab，进程结束时释放
+
+        std::atomic<uint64_t> _in_use;     // 正在使用的块数
+        std::atomic<uint64_t> _high_water; // 同时使用的块数峰值
+        std::atomic<uint64_t> _allocated;  // 累计申请次数
+        std::atomic<uint64_t> _misses;     // 全局链表为空需要新建slab的次数
+        std::atomic<uint64_t> _oversize;   // 超过块大小单独申请的次数
+    };
+
+    // 侵入式引用计数的消息，拷贝时只增加计数，广播的所有接收者和分块共用同一个块
+    class MessageRef
+    {
+    public:
+        MessageRef()
+            : _block(nullptr)
+        {
+        }
+
+        MessageRef(const char *data, size_t len)
+            : _block(MessagePool::getInstance().allocate(data, len))
+        {
+        }
+
+        MessageRef(const MessageRef &m)
+            : _block(m._block)
+        {
+            if (_block)
+                _block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        MessageRef(MessageRef &&m) noexcept
+            : _block(m._block)
+        {
+            m._block = nullptr;
+        }
+
+        MessageRef &operator=(MessageRef m)
+        {
+            std::swap(_block, m._block);
+            return *this;
+        }
+
+        std::string_view view() const
+        {
+            return _block ? std::string_view(_block->data(), _block->len) : std::string_view();
+        }
+
+        ~MessageRef()
+        {
+            if (_block)
+                MessagePool::getInstance().release(_block);
+        }
+
+    private:
+        MessageBlock *_block;
+    };
+}
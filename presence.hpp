@@ -0,0 +1,278 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <random>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "protocol.hpp"
+
+namespace PresenceModule
+{
+    using namespace ProtocolModule;
+
+    // 在线列表同步帧：
+    // 查询：[magic][P][纪元 4B][已知版本 8B]
+    // 更新：[magic][U][标志 1B][纪元 4B][起始版本 8B][结束版本 8B][条数 2B][变更...]
+    // 变更：[操作 1B('+'/'-')][IPv4 4B][端口 2B][名字长度 1B][名字]
+    // 增量更新中每个报文的变更从起始版本之后开始，到结束版本为止；客户端版本等于起始版本时才应用
+    // 全量更新的第一个报文带Reset标志，最后一个报文带Last标志，收到Last后客户端版本变为结束版本
+    // 纪元在服务器启动时随机生成，重启后版本号重新开始，纪元不同时服务器返回全量更新
+    const uint8_t presence_snapshot = 1; // 全量更新
+    const uint8_t presence_reset = 2;    // 全量更新的第一个报文，客户端清空列表
+    const uint8_t presence_last = 4;     // 本次回复的最后一个报文
+
+    const size_t presence_query_size = frame_head_size + 12;
+    const size_t presence_head_size = frame_head_size + 23;
+
+    const size_t d_presence_log = 4096;      // 保留的变更条数，落后更多时发送全量
+    const size_t d_presence_datagram = 1200; // 单个更新报文的最大长度
+
+    inline void putU64(std::string &out, uint64_t value)
+    {
+        putU32(out, static_cast<uint32_t>(value >> 32));
+        putU32(out, static_cast<uint32_t>(value));
+    }
+
+    inline uint64_t getU64(const char *p)
+    {
+        return (static_cast<uint64_t>(getU32(p)) << 32) | getU32(p + 4);
+    }
+
+    // 一次成员变更，version为变更后的列表版本
+    struct PresenceChange
+    {
+        uint64_t version;
+        bool online;
+        struct sockaddr_in addr;
+        std::string name;
+    };
+
+    inline std::string presenceQuery(uint32_t epoch, uint64_t version)
+    {
+        std::string frame;
+        putFrameHead(frame, FrameType::PresenceQuery);
+        putU32(frame, epoch);
+        putU64(frame, version);
+        return frame;
+    }
+
+    inline bool parsePresenceQuery(const char *data, size_t len, uint32_t &epoch, uint64_t &version)
+    {
+        if (len < presence_query_size || !isFrame(data, len, FrameType::PresenceQuery))
+            return false;
+        epoch = getU32(data + frame_head_size);
+        version = getU64(data + frame_head_size + 4);
+        return true;
+    }
+
+    // 把变更编码为若干个更新报文，snapshot为true时changes是当前的全部在线用户
+    inline std::vector<std::string> encodePresence(uint32_t epoch, uint64_t from, uint64_t to, bool snapshot, const std::vector<PresenceChange> &changes)
+    {
+        std::vector<std::string> frames;
+        size_t i = 0;
+        do
+        {
+            std::string body;
+            uint16_t count = 0;
+            uint64_t first = from;
+            uint64_t last = to;
+            if (!snapshot && i < changes.size())
+                first = changes[i].version - 1;
+
+            while (i < changes.size())
+            {
+                const PresenceChange &c = changes[i];
+                size_t name_len = std::min<size_t>(c.name.size(), 255);
+                if (count > 0 && presence_head_size + body.size() + 8 + name_len > d_presence_datagram)
+                    break;
+                body.push_back(c.online ? '+' : '-');
+                body.append(reinterpret_cast<const char *>(&c.addr.sin_addr.s_addr), 4);
+                body.append(reinterpret_cast<const char *>(&c.addr.sin_port), 2);
+                body.push_back(static_cast<char>(name_len));
+                body.append(c.name.data(), name_len);
+                if (!snapshot)
+                    last = c.version;
+                count++;
+                i++;
+            }
+
+            uint8_t flags = 0;
+            if (snapshot)
+                flags |= presence_snapshot | (frames.empty() ? presence_reset : 0);
+            if (i == changes.size())
+                flags |= presence_last;
+
+            std::string frame;
+            frame.reserve(presence_head_size + body.size());
+            putFrameHead(frame, FrameType::PresenceUpdate);
+            frame.push_back(static_cast<char>(flags));
+            putU32(frame, epoch);
+            putU64(frame, first);
+            putU64(frame, last);
+            putU16(frame, count);
+            frame += body;
+            frames.push_back(std::move(frame));
+        } while (i < changes.size());
+        return frames;
+    }
+
+    // 服务器端的成员变更日志，调用方负责加锁
+    class PresenceLog
+    {
+    public:
+        PresenceLog(size_t capacity = d_presence_log)
+            : _capacity(capacity), _epoch(std::random_device()())
+        {
+        }
+
+        void record(uint64_t version, bool online, const struct sockaddr_in &addr, const std::string &name)
+        {
+            _log.push_back(PresenceChange{version, online, addr, name});
+            if (_log.size() > _capacity)
+                _log.pop_front();
+        }
+
+        // 取出version之后的变更，日志中已经没有需要的变更时返回false，调用方改为发送全量
+        bool since(uint32_t epoch, uint64_t version, uint64_t current, std::vector<PresenceChange> &changes)
+        {
+            if (epoch != _epoch || version > current)
+                return false;
+            if (version == current)
+                return true;
+            if (_log.empty() || _log.front().version > version + 1)
+                return false;
+
+            // 版本号连续递增，直接定位
+            size_t start = version + 1 - _log.front().version;
+            changes.assign(_log.begin() + start, _log.end());
+            return true;
+        }
+
+        uint32_t getEpoch()
+        {
+            return _epoch;
+        }
+
+    private:
+        size_t _capacity;
+        uint32_t _epoch;
+        std::deque<PresenceChange> _log;
+    };
+
+    // 客户端维护的在线列表
+    class PresenceRoster
+    {
+    public:
+        PresenceRoster()
+            : _epoch(0), _version(0), _syncing(false)
+        {
+        }
+
+        // 应用一个更新报文，返回本次回复是否已经完整应用
+        // 报文与本地版本不连续时返回false并标记需要重新查询
+        bool apply(const char *data, size_t len)
+        {
+            if (len < presence_head_size || !isFrame(data, len, FrameType::PresenceUpdate))
+                return false;
+
+            uint8_t flags = static_cast<uint8_t>(data[frame_head_size]);
+            uint32_t epoch = getU32(data + frame_head_size + 1);
+            uint64_t from = getU64(data + frame_head_size + 5);
+            uint64_t to = getU64(data + frame_head_size + 13);
+            uint16_t count = getU16(data + frame_head_size + 21);
+
+            bool snapshot = flags & presence_snapshot;
+            if (snapshot)
+            {
+                if (flags & presence_reset)
+                {
+                    _pending.clear();
+                    _syncing = true;
+                }
+                else if (!_syncing)
+                    return false;
+            }
+            else if (epoch != _epoch || from != _version)
+            {
+                _stale = true;
+                return false;
+            }
+
+            const char *p = data + presence_head_size;
+            const char *end = data + len;
+            for (uint16_t k = 0; k < count; k++)
+            {
+                if (end - p < 8 || end - p < 8 + static_cast<uint8_t>(p[7]))
+                    return false;
+                bool online = p[0] == '+';
+                struct sockaddr_in addr;
+                memcpy(&addr.sin_addr.s_addr, p + 1, 4);
+                memcpy(&addr.sin_port, p + 5, 2);
+                uint64_t key = addrKey(addr);
+                std::string name(p + 8, static_cast<uint8_t>(p[7]));
+                p += 8 + name.size();
+
+                std::map<uint64_t, std::string> &target = snapshot ? _pending : _users;
+                if (online)
+                    target[key] = name;
+                else
+                    target.erase(key);
+            }
+
+            if (snapshot)
+            {
+                if (!(flags & presence_last))
+                    return false;
+                _users.swap(_pending);
+                _pending.clear();
+                _syncing = false;
+            }
+            _epoch = epoch;
+            _version = to;
+            _stale = false;
+            return flags & presence_last;
+        }
+
+        std::string query()
+        {
+            return presenceQuery(_epoch, _version);
+        }
+
+        bool isStale()
+        {
+            return _stale;
+        }
+
+        uint64_t getVersion()
+        {
+            return _version;
+        }
+
+        // 按"名字(IP:端口)"列出在线用户
+        std::vector<std::string> list()
+        {
+            std::vector<std::string> out;
+            for (auto &u : _users)
+            {
+                struct in_addr ip;
+                ip.s_addr = static_cast<uint32_t>(u.first >> 16);
+                char buf[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &ip, buf, sizeof(buf));
+                out.push_back(u.second + "(" + buf + ":" + std::to_string(ntohs(static_cast<uint16_t>(u.first))) + ")");
+            }
+            return out;
+        }
+
+    private:
+        uint32_t _epoch;
+        uint64_t _version;
+        bool _syncing;      // 正在接收全量更新
+        bool _stale = false; // 收到不连续的增量，需要重新查询
+        std::map<uint64_t, std::string> _users;   // 地址 -> 名字
+        std::map<uint64_t, std::string> _pending; // 正在接收的全量列表
+    };
+}
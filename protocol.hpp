@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <time.h>
+#include <arpa/inet.h>
+
+namespace ProtocolModule
+{
+    // 普通聊天消息为"名字:内容"的文本，控制帧以不可见字符0x02开头，避免与文本冲突
+    const char frame_magic = '\x02';
+
+    // 控制帧类型，紧跟在frame_magic之后
+    enum class FrameType : char
+    {
+        Federation = 'F',    // 服务器节点之间转发的消息
+        ReliableHello = 'H', // 客户端请求可靠投递，放在cookie帧中发送
+        ReliableData = 'D',  // 带序号的可靠投递消息
+        ReliableAck = 'A',   // 客户端批量确认
+        Fragment = 'G',      // 超长消息的分片
+        MulticastJoin = 'M', // 客户端已加入组播组，广播不再单播给它，放在cookie帧中发送
+        PresenceQuery = 'P', // 客户端查询在线列表的变更
+        PresenceUpdate = 'U', // 在线列表的增量或全量更新
+        Cookie = 'C',         // 上线握手的cookie挑战和回复
+    };
+
+    // 帧头长度：magic + 类型
+    const size_t frame_head_size = 2;
+
+    // 判断收到的数据是否为指定类型的控制帧
+    inline bool isFrame(const char *data, size_t len, FrameType type)
+    {
+        return len >= frame_head_size && data[0] == frame_magic && data[1] == static_cast<char>(type);
+    }
+
+    // 写入帧头
+    inline void putFrameHead(std::string &out, FrameType type)
+    {
+        out.push_back(frame_magic);
+        out.push_back(static_cast<char>(type));
+    }
+
+    // 按网络字节序写入/读取整数
+    inline void putU16(std::string &out, uint16_t value)
+    {
+        value = htons(value);
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    inline void putU32(std::string &out, uint32_t value)
+    {
+        value = htonl(value);
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    inline uint16_t getU16(const char *p)
+    {
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        return ntohs(value);
+    }
+
+    inline uint32_t getU32(const char *p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return ntohl(value);
+    }
+
+    // 以IP和端口作为地址的键
+    inline uint64_t addrKey(const struct sockaddr_in &addr)
+    {
+        return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+    }
+
+    // 单调时钟毫秒数，用于协议中的各种定时
+    inline uint64_t nowMs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <iostream>
+#include <coroutine>
+#include <exception>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "log.hpp"
+
+namespace ReactorModule
+{
+    using namespace LogSystemModule;
+
+    const int d_max_events = 64; // 每次epoll_wait最多取出的事件数
+
+    // 分离执行的顶层协程：创建后立即运行，执行结束时自动释放
+    struct Task
+    {
+        struct promise_type
+        {
+            Task get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    // 可等待的处理步骤：被co_await时才开始执行，执行结束后恢复调用者
+    class Step
+    {
+    public:
+        struct promise_type
+        {
+            std::coroutine_handle<> continuation;
+
+            Step get_return_object() { return Step(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            // 结束时直接切换回调用者，不经过事件循环
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    std::coroutine_handle<> c = h.promise().continuation;
+                    return c ? c : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        explicit Step(std::coroutine_handle<promise_type> h)
+            : _h(h)
+        {
+        }
+
+        Step(Step &&other) noexcept
+            : _h(other._h)
+        {
+            other._h = nullptr;
+        }
+
+        Step(const Step &) = delete;
+        Step &operator=(const Step &) = delete;
+
+        bool await_ready() { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+        {
+            _h.promise().continuation = caller;
+            return _h;
+        }
+        void await_resume() {}
+
+        ~Step()
+        {
+            if (_h)
+                _h.destroy();
+        }
+
+    private:
+        std::coroutine_handle<promise_type> _h;
+    };
+
+    // 单线程事件循环，只能在运行它的线程中注册等待和恢复协程
+    // 文件描述符以边沿触发注册一次，协程在系统调用返回EAGAIN后等待可读或可写
+    // 同一个文件描述符上可以有多个协程等待同一方向，就绪时全部恢复，由它们各自重试系统调用
+    class EventLoop
+    {
+    private:
+        struct Waiters
+        {
+            std::vector<std::coroutine_handle<>> readers;
+            std::vector<std::coroutine_handle<>> writers;
+        };
+
+        // 把等待列表中的协程全部放入就绪队列
+        void wake(std::vector<std::coroutine_handle<>> &waiters)
+        {
+            for (auto h : waiters)
+                _ready.push_back(h);
+            waiters.clear();
+        }
+
+        // 等待文件描述符就绪
+        struct IoAwaiter
+        {
+            EventLoop *loop;
+            int fd;
+            bool write;
+
+            bool await_ready() { return loop->isStopped(); }
+            void await_suspend(std::coroutine_handle<> h) { loop->wait(fd, write, h); }
+            void await_resume() {}
+        };
+
+        // 让出事件循环，排到已就绪的协程之后
+        struct YieldAwaiter
+        {
+            EventLoop *loop;
+
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> h) { loop->_ready.push_back(h); }
+            void await_resume() {}
+        };
+
+        void wait(int fd, bool write, std::coroutine_handle<> h)
+        {
+            auto it = _waiters.find(fd);
+            if (it == _waiters.end())
+            {
+                struct epoll_event ev;
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                ev.data.fd = fd;
+                if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                    LOG(LogLevel::ERROR) << "注册文件描述符失败：" << strerror(errno);
+                it = _waiters.emplace(fd, Waiters()).first;
+            }
+            (write ? it->second.writers : it->second.readers).push_back(h);
+        }
+
+        // 执行当前已就绪的协程，执行期间新就绪的留到下一轮，避免饿死I/O事件
+        void runReady()
+        {
+            std::deque<std::coroutine_handle<>> ready;
+            ready.swap(_ready);
+            for (auto h : ready)
+                h.resume();
+        }
+
+    public:
+        EventLoop()
+            : _epfd(epoll_create1(EPOLL_CLOEXEC)), _wakefd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), _stopped(false)
+        {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = _wakefd;
+            epoll_ctl(_epfd, EPOLL_CTL_ADD, _wakefd, &ev);
+        }
+
+        EventLoop(const EventLoop &) = delete;
+        EventLoop &operator=(const EventLoop &) = delete;
+
+        IoAwaiter readable(int fd) { return IoAwaiter{this, fd, false}; }
+        IoAwaiter writable(int fd) { return IoAwaiter{this, fd, true}; }
+        YieldAwaiter yield() { return YieldAwaiter{this}; }
+
+        bool isStopped() { return _stopped; }
+
+        // 运行到stop被调用，退出前恢复所有等待中的协程，由它们检查isStopped后结束
+        void run()
+        {
+            struct epoll_event events[d_max_events];
+            while (!_stopped)
+            {
+                runReady();
+
+                int n = epoll_wait(_epfd, events, d_max_events, _ready.empty() ? -1 : 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+
+                for (int i = 0; i < n; i++)
+                {
+                    int fd = events[i].data.fd;
+                    if (fd == _wakefd)
+                    {
+                        uint64_t value;
+                        while (read(_wakefd, &value, sizeof(value)) > 0)
+                            ;
+                        continue;
+                    }
+
+                    auto it = _waiters.find(fd);
+                    if (it == _waiters.end())
+                        continue;
+                    Waiters &w = it->second;
+                    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                        wake(w.readers);
+                    if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                        wake(w.writers);
+                }
+            }
+
+            for (auto &w : _waiters)
+            {
+                wake(w.second.readers);
+                wake(w.second.writers);
+            }
+            while (!_ready.empty())
+                runReady();
+        }
+
+        // 可以在其他线程或信号处理函数中调用
+        void stop()
+        {
+            _stopped = true;
+            uint64_t one = 1;
+            ssize_t ret = write(_wakefd, &one, sizeof(one));
+            (void)ret;
+        }
+
+        ~EventLoop()
+        {
+            close(_wakefd);
+            close(_epfd);
+        }
+
+    private:
+        int _epfd;
+        int _wakefd;
+        volatile bool _stopped;
+        std::deque<std::coroutine_handle<>> _ready;       // 已就绪等待恢复的协程
+        std::unordered_map<int, Waiters> _waiters;        // 文件描述符 -> 等待中的协程
+    };
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <netinet/in.h>
+
+namespace RecipientModule
+{
+    using recipient_handle_t = uint32_t; // 用户在线期间不变的句柄
+    using name_id_t = uint32_t;          // 名字表中的编号
+
+    const recipient_handle_t invalid_handle = UINT32_MAX;
+    const name_id_t invalid_name = UINT32_MAX;
+
+    // 分发使用的地址快照：只有单播接收者的地址，连续存放
+    using recipient_list_t = std::vector<struct sockaddr_in>;
+
+    // 名字表：同一个名字只保存一份，用户按编号引用，引用计数为0时编号回收
+    class NameTable
+    {
+    public:
+        name_id_t intern(const std::string &name)
+        {
+            auto it = _ids.find(name);
+            if (it != _ids.end())
+            {
+                _refs[it->second]++;
+                return it->second;
+            }
+
+            name_id_t id;
+            if (!_free.empty())
+            {
+                id = _free.back();
+                _free.pop_back();
+                _names[id] = name;
+                _refs[id] = 1;
+            }
+            else
+            {
+                id = static_cast<name_id_t>(_names.size());
+                _names.push_back(name);
+                _refs.push_back(1);
+            }
+            // deque尾部插入不移动已有元素，索引可以直接引用表中的字符串
+            _ids.emplace(_names[id], id);
+            return id;
+        }
+
+        void release(name_id_t id)
+        {
+            if (--_refs[id] > 0)
+                return;
+            _ids.erase(_names[id]);
+            _names[id].clear();
+            _free.push_back(id);
+        }
+
+        // 查找名字的编号，不存在时返回invalid_name
+        name_id_t find(const std::string &name) const
+        {
+            auto it = _ids.find(name);
+            return it == _ids.end() ? invalid_name : it->second;
+        }
+
+        const std::string &get(name_id_t id) const
+        {
+            return _names[id];
+        }
+
+    private:
+        std::deque<std::string> _names;                          // 编号 -> 名字
+        std::vector<uint32_t> _refs;                             // 编号 -> 引用计数
+        std::vector<name_id_t> _free;                            // 可以复用的编号
+        std::unordered_map<std::string_view, name_id_t> _ids;    // 名字 -> 编号
+    };
+
+    // 分发时用不到的用户数据，与地址数组按下标对应
+    struct RecipientInfo
+    {
+        name_id_t name;
+        std::shared_ptr<const std::string> prefix; // 发送者前缀
+        recipient_handle_t handle;
+    };
+
+    // 接收者表：地址和其余数据分成两个数组，分发只遍历连续的地址数组
+    // 单播接收者排在前面，组播成员排在后面，分发时不需要逐个判断
+    // 删除时与末尾交换后弹出，句柄通过间接表映射到当前下标，交换后句柄不变
+    // 不加锁，由UserManager在持有锁时修改
+    class RecipientTable
+    {
+    private:
+        void swapSlots(size_t a, size_t b)
+        {
+            if (a == b)
+                return;
+            std::swap(_addrs[a], _addrs[b]);
+            std::swap(_info[a], _info[b]);
+            _slots[_info[a].handle] = static_cast<uint32_t>(a);
+            _slots[_info[b].handle] = static_cast<uint32_t>(b);
+        }
+
+    public:
+        RecipientTable()
+            : _unicast(0)
+        {
+        }
+
+        // 新用户作为单播接收者加入
+        recipient_handle_t add(const struct sockaddr_in &addr, name_id_t name, std::shared_ptr<const std::string> prefix)
+        {
+            recipient_handle_t handle;
+            if (!_free.empty())
+            {
+                handle = _free.back();
+                _free.pop_back();
+            }
+            else
+            {
+                handle = static_cast<recipient_handle_t>(_slots.size());
+                _slots.push_back(0);
+            }
+
+            _addrs.push_back(addr);
+            _info.push_back(RecipientInfo{name, std::move(prefix), handle});
+            _slots[handle] = static_cast<uint32_t>(_addrs.size() - 1);
+            // 移到单播区的末尾，原来在该位置的组播成员换到表尾
+            swapSlots(_addrs.size() - 1, _unicast);
+            _unicast++;
+            return handle;
+        }
+
+        void remove(recipient_handle_t handle)
+        {
+            size_t index = _slots[handle];
+            // 单播接收者先换到单播区末尾，单播区缩小一个
+            if (index < _unicast)
+            {
+                swapSlots(index, _unicast - 1);
+                index = --_unicast;
+            }
+            swapSlots(index, _addrs.size() - 1);
+            _addrs.pop_back();
+            _info.pop_back();
+            _slots[handle] = invalid_handle;
+            _free.push_back(handle);
+        }
+
+        // 改为组播接收：换到单播区之外
+        void setMulticast(recipient_handle_t handle)
+        {
+            size_t index = _slots[handle];
+            if (index >= _unicast)
+                return;
+            swapSlots(index, _unicast - 1);
+            _unicast--;
+        }
+
+        bool isMulticast(recipient_handle_t handle) const
+        {
+            return _slots[handle] >= _unicast;
+        }
+
+        const struct sockaddr_in &getAddr(recipient_handle_t handle) const
+        {
+            return _addrs[_slots[handle]];
+        }
+
+        const RecipientInfo &getInfo(recipient_handle_t handle) const
+        {
+            return _info[_slots[handle]];
+        }
+
+        // 按下标遍历所有用户
+        const struct sockaddr_in &addrAt(size_t index) const
+        {
+            return _addrs[index];
+        }
+
+        const RecipientInfo &infoAt(size_t index) const
+        {
+            return _info[index];
+        }
+
+        // 单播接收者的地址数组
+        recipient_list_t unicastList() const
+        {
+            return recipient_list_t(_addrs.begin(), _addrs.begin() + _unicast);
+        }
+
+        size_t size() const
+        {
+            return _addrs.size();
+        }
+
+        size_t unicastCount() const
+        {
+            return _unicast;
+        }
+
+    private:
+        std::vector<struct sockaddr_in> _addrs; // 热数据：所有用户的地址，单播在前
+        std::vector<RecipientInfo> _info;       // 冷数据：与_addrs下标对应
+        std::vector<uint32_t> _slots;           // 句柄 -> 当前下标
+        std::vector<recipient_handle_t> _free;  // 可以复用的句柄
+        size_t _unicast;                        // 单播接收者个数
+    };
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <bitset>
+#include <unordered_map>
+#include <time.h>
+#include <unistd.h>
+#include "sockaddr_in_t.hpp"
+#include "protocol.hpp"
+#include "mutex.hpp"
+#include "thread.hpp"
+#include "log.hpp"
+
+namespace ReliableModule
+{
+    using namespace SockAddrInModule;
+    using namespace ProtocolModule;
+    using namespace MutexModule;
+    using namespace ThreadModule;
+    using namespace LogSystemModule;
+
+    const size_t d_window_size = 256; // 每个接收者最多保存的未确认消息数
+    const int d_rto_ms = 100;         // 首次重传超时
+    const int d_max_retries = 5;      // 最大重传次数，超过后放弃
+    const size_t d_max_recipients = 65536; // 最多记录的可靠投递接收者数
+    const int d_tick_ms = 20;         // 重传定时器间隔
+    const uint32_t d_ack_batch = 16;  // 客户端每收到多少条消息确认一次
+    const int d_ack_delay_ms = 20;    // 客户端最长延迟确认时间
+    const uint32_t d_recv_window = 1024; // 客户端记录的乱序范围，需大于服务器窗口
+
+    // 数据帧：[0x02]['D'][epoch 4B][seq 4B][消息]
+    const size_t data_head_size = frame_head_size + 8;
+    // 确认帧：[0x02]['A'][epoch 4B][ack 4B][bitmap 32B]
+    // ack表示序号小于ack的消息都已收到，bitmap第i位表示序号ack+1+i已收到，覆盖整个发送窗口
+    const uint32_t d_sack_bits = 256;
+    const size_t ack_frame_size = frame_head_size + 8 + d_sack_bits / 8;
+
+    // 服务器端：为每个开启可靠投递的接收者维护序号和重传窗口
+    class ReliableSender
+    {
+    private:
+        struct Pending
+        {
+            uint32_t seq;
+            uint64_t sent_ms; // 最后一次发送时间
+            int retries;      // 已重传次数
+            bool acked;       // 已被选择确认
+            std::string frame;
+        };
+
+        struct Recipient
+        {
+            struct sockaddr_in addr;
+            uint32_t epoch;
+            uint32_t next_seq;
+            std::deque<Pending> window; // 按序号递增排列的未确认消息
+        };
+
+        void sendFrame(const Recipient &r, const std::string &frame)
+        {
+            ssize_t ret = sendto(_sockfd, frame.data(), frame.size(), 0,
+                                 reinterpret_cast<const struct sockaddr *>(&r.addr), sizeof(r.addr));
+            if (ret < 0)
+                _send_errors++;
+        }
+
+        // 定时扫描所有窗口，重传超时的消息
+        void run()
+        {
+            uint64_t last_report = nowMs();
+            while (_isRunning)
+            {
+                usleep(d_tick_ms * 1000);
+                uint64_t now = nowMs();
+
+                {
+                    MutexGuard guard(_lock);
+                    for (auto &item : _recipients)
+                    {
+                        Recipient &r = item.second;
+                        for (auto &p : r.window)
+                        {
+                            // 指数退避
+                            if (p.acked || now - p.sent_ms < (static_cast<uint64_t>(_rto_ms) << p.retries))
+                                continue;
+
+                            if (p.retries >= _max_retries)
+                            {
+                                p.acked = true;
+                                _lost++;
+                                continue;
+                            }
+
+                            sendFrame(r, p.frame);
+                            p.sent_ms = now;
+                            p.retries++;
+                            _retransmitted++;
+                        }
+
+                        while (!r.window.empty() && r.window.front().acked)
+                            r.window.pop_front();
+                    }
+                }
+
+                if (now - last_report >= 10000)
+                {
+                    last_report = now;
+                    printStats();
+                }
+            }
+        }
+
+    public:
+        ReliableSender(size_t window = d_window_size, int rto_ms = d_rto_ms, int max_retries = d_max_retries)
+            : _sockfd(-1), _window(window), _rto_ms(rto_ms), _max_retries(max_retries), _next_epoch(static_cast<uint32_t>(time(NULL))),
+              _sent(0), _retransmitted(0), _acks(0), _lost(0), _overflow(0), _send_errors(0), _rejected(0), _isRunning(false),
+              _thread([this]()
+                      { run(); })
+        {
+        }
+
+        // 启动重传定时器
+        void start(int sockfd)
+        {
+            if (_isRunning)
+                return;
+
+            _sockfd = sockfd;
+            _isRunning = true;
+            _thread.start();
+        }
+
+        void stop()
+        {
+            if (_isRunning)
+            {
+                _isRunning = false;
+                _thread.join();
+                printStats();
+            }
+        }
+
+        // 接收者请求可靠投递，重新开始计数，接收者数达到上限时拒绝新的地址
+        bool addRecipient(const struct sockaddr_in &addr)
+        {
+            MutexGuard guard(_lock);
+            if (_recipients.size() >= d_max_recipients && _recipients.find(addrKey(addr)) == _recipients.end())
+            {
+                _rejected++;
+                return false;
+            }
+
+            Recipient &r = _recipients[addrKey(addr)];
+            r.addr = addr;
+            r.epoch = _next_epoch++;
+            r.next_seq = 1;
+            r.window.clear();
+            return true;
+        }
+
+        void removeRecipient(const struct sockaddr_in &addr)
+        {
+            MutexGuard guard(_lock);
+            _recipients.erase(addrKey(addr));
+        }
+
+        // 接收者开启了可靠投递时带序号发送并返回true，否则返回false由调用方直接发送
+        bool send(const struct sockaddr_in &addr, const std::string &prefix, std::string_view message)
+        {
+            MutexGuard guard(_lock);
+            auto it = _recipients.find(addrKey(addr));
+            if (it == _recipients.end())
+                return false;
+
+            Recipient &r = it->second;
+            Pending p;
+            p.seq = r.next_seq++;
+            p.sent_ms = nowMs();
+            p.retries = 0;
+            p.acked = false;
+            p.frame.reserve(data_head_size + prefix.size() + message.size());
+            putFrameHead(p.frame, FrameType::ReliableData);
+            putU32(p.frame, r.epoch);
+            putU32(p.frame, p.seq);
+            p.frame += prefix;
+            p.frame += message;
+
+            sendFrame(r, p.frame);
+            _sent++;
+
+            // 窗口已满时放弃最早的消息，保证内存有上限
+            if (r.window.size() >= _window)
+            {
+                r.window.pop_front();
+                _overflow++;
+            }
+            r.window.push_back(std::move(p));
+            return true;
+        }
+
+        // 处理客户端的批量确认
+        void onAck(const char *data, size_t len, const struct sockaddr_in &from)
+        {
+            if (len < ack_frame_size)
+                return;
+
+            uint32_t epoch = getU32(data + frame_head_size);
+            uint32_t ack = getU32(data + frame_head_size + 4);
+            const char *bitmap = data + frame_head_size + 8;
+
+            MutexGuard guard(_lock);
+            auto it = _recipients.find(addrKey(from));
+            if (it == _recipients.end() || it->second.epoch != epoch)
+                return;
+
+            _acks++;
+            Recipient &r = it->second;
+            for (auto &p : r.window)
+            {
+                if (p.seq < ack)
+                    p.acked = true;
+                else if (p.seq > ack && p.seq - ack - 1 < d_sack_bits)
+                {
+                    uint32_t i = p.seq - ack - 1;
+                    if ((bitmap[i / 8] >> (i % 8)) & 1)
+                        p.acked = true;
+                }
+            }
+
+            while (!r.window.empty() && r.window.front().acked)
+                r.window.pop_front();
+        }
+
+        void printStats()
+        {
+            LOG(LogLevel::INFO) << "可靠投递统计 发送：" << _sent << " 重传：" << _retransmitted << " 确认帧：" << _acks
+                                << " 放弃：" << _lost << " 窗口溢出：" << _overflow << " 发送失败：" << _send_errors
+                                << " 拒绝接收者：" << _rejected;
+        }
+
+        ~ReliableSender()
+        {
+            stop();
+        }
+
+    private:
+        int _sockfd;
+        size_t _window;
+        int _rto_ms;
+        int _max_retries;
+        uint32_t _next_epoch;
+        std::unordered_map<uint64_t, Recipient> _recipients;
+        Mutex _lock;
+
+        uint64_t _sent;
+        uint64_t _retransmitted;
+        uint64_t _acks;
+        uint64_t _lost;
+        uint64_t _overflow;
+        uint64_t _send_errors;
+        uint64_t _rejected; // 接收者数达到上限时拒绝的请求数
+
+        volatile bool _isRunning;
+        Thread _thread;
+    };
+
+    // 客户端：去重并按批次生成确认帧
+    class ReliableReceiver
+    {
+    private:
+        // 期望序号前移一位，并吸收后面已经收到的消息
+        void advance()
+        {
+            _expected++;
+            while (_received.test(_expected % d_recv_window))
+            {
+                _received.reset(_expected % d_recv_window);
+                _expected++;
+            }
+        }
+
+    public:
+        ReliableReceiver()
+            : _epoch(0), _expected(1), _unacked(0), _last_ack_ms(0), _duplicates(0), _skipped(0)
+        {
+        }
+
+        // 构建开启可靠投递的请求帧
+        static std::string helloFrame()
+        {
+            std::string frame;
+            putFrameHead(frame, FrameType::ReliableHello);
+            return frame;
+        }
+
+        // 处理数据帧，新消息返回true并设置message，重复消息返回false
+        bool onData(const char *data, size_t len, std::string &message)
+        {
+            if (len < data_head_size)
+                return false;
+
+            uint32_t epoch = getU32(data + frame_head_size);
+            uint32_t seq = getU32(data + frame_head_size + 4);
+
+            // 服务器重新开始计数
+            if (epoch != _epoch)
+            {
+                _epoch = epoch;
+                _expected = 1;
+                _received.reset();
+            }
+
+            _unacked++;
+
+            if (seq < _expected)
+            {
+                _duplicates++;
+                return false;
+            }
+
+            // 超出乱序范围时，认为最早的缺口已被服务器放弃
+            while (seq - _expected >= d_recv_window)
+            {
+                advance();
+                _skipped++;
+            }
+
+            if (seq == _expected)
+                advance();
+            else
+            {
+                if (_received.test(seq % d_recv_window))
+                {
+                    _duplicates++;
+                    return false;
+                }
+                _received.set(seq % d_recv_window);
+            }
+
+            message.assign(data + data_head_size, len - data_head_size);
+            return true;
+        }
+
+        // 累计收到足够多的消息或者等待超时后需要确认
+        bool needAck()
+        {
+            if (_unacked == 0)
+                return false;
+            return _unacked >= d_ack_batch || nowMs() - _last_ack_ms >= static_cast<uint64_t>(d_ack_delay_ms);
+        }
+
+        std::string ackFrame()
+        {
+            std::string frame;
+            frame.reserve(ack_frame_size);
+            putFrameHead(frame, FrameType::ReliableAck);
+            putU32(frame, _epoch);
+            putU32(frame, _expected);
+
+            // 选择确认紧跟在_expected之后的d_sack_bits条消息
+            char bitmap[d_sack_bits / 8] = {0};
+            for (uint32_t i = 0; i < d_sack_bits; i++)
+                if (_received.test((_expected + 1 + i) % d_recv_window))
+                    bitmap[i / 8] |= 1 << (i % 8);
+            frame.append(bitmap, sizeof(bitmap));
+
+            _unacked = 0;
+            _last_ack_ms = nowMs();
+            return frame;
+        }
+
+        uint64_t getDuplicates()
+        {
+            return _duplicates;
+        }
+
+        uint64_t getSkipped()
+        {
+            return _skipped;
+        }
+
+    private:
+        uint32_t _epoch;
+        uint32_t _expected;                     // 期望收到的最小序号
+        std::bitset<d_recv_window> _received; // 已收到的乱序消息，按序号取模
+        uint32_t _unacked;     // 上次确认之后收到的数据帧数
+        uint64_t _last_ack_ms; // 上次确认时间
+        uint64_t _duplicates;  // 重复消息数
+        uint64_t _skipped;     // 放弃等待的消息数
+    };
+}
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace SanitizeModule
+{
+    // 聊天消息在接收时检查一次：找出名字分隔符':'，校验UTF-8，检查会被终端解释的控制字符
+    // 允许的控制字符只有\t，其余C0控制字符、DEL和C1控制字符(U+0080~U+009F)都不允许，
+    // 换行可以伪造另一条消息，ESC和C1的CSI可以改写接收者的终端
+    // 绝大多数消息没有问题，扫描后直接使用原始数据；有问题的消息再改写一遍：
+    // 控制字符转义为\xNN或\u00NN，无效的UTF-8字节替换为U+FFFD
+    const size_t no_colon = SIZE_MAX;
+
+    struct ScanResult
+    {
+        size_t colon; // 第一个':'的位置，没有时为no_colon
+        bool clean;   // 是否可以原样转发，为false时colon无意义
+    };
+
+    // 从p[i]开始解码一个非ASCII字符，合法时返回字符的字节数，否则返回0
+    // 拒绝过长编码、代理区和超过U+10FFFF的码点
+    inline size_t utf8Sequence(const unsigned char *p, size_t i, size_t len, uint32_t &cp)
+    {
+        unsigned char c = p[i];
+        size_t n = 0;
+        uint32_t min = 0;
+        if (c >= 0xc2 && c <= 0xdf)
+        {
+            n = 2;
+            cp = c & 0x1f;
+            min = 0x80;
+        }
+        else if (c >= 0xe0 && c <= 0xef)
+        {
+            n = 3;
+            cp = c & 0x0f;
+            min = 0x800;
+        }
+        else if (c >= 0xf0 && c <= 0xf4)
+        {
+            n = 4;
+            cp = c & 0x07;
+            min = 0x10000;
+        }
+        else
+            return 0;
+
+        if (len - i < n)
+            return 0;
+        for (size_t k = 1; k < n; k++)
+        {
+            if ((p[i + k] & 0xc0) != 0x80)
+                return 0;
+            cp = (cp << 6) | (p[i + k] & 0x3f);
+        }
+        if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+            return 0;
+        return n;
+    }
+
+    inline bool isControl(uint32_t cp)
+    {
+        return (cp < 0x20 && cp != '\t') || (cp >= 0x7f && cp <= 0x9f);
+    }
+
+    // 检查一个字符，合法时推进i并返回true，遇到':'时记录位置
+    inline bool scanOne(const unsigned char *p, size_t &i, size_t len, size_t &colon)
+    {
+        unsigned char c = p[i];
+        if (c < 0x80)
+        {
+            if (isControl(c))
+                return false;
+            if (c == ':' && colon == no_colon)
+                colon = i;
+            i++;
+            return true;
+        }
+
+        uint32_t cp = 0;
+        size_t n = utf8Sequence(p, i, len, cp);
+        if (n == 0 || isControl(cp))
+            return false;
+        i += n;
+        return true;
+    }
+
+    // 逐字符实现，也用于处理SSE2实现不足一个块的尾部，可打印ASCII在内层循环中连续处理
+    inline ScanResult scanScalar(const char *data, size_t len, size_t i = 0, size_t colon = no_colon)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        while (i < len)
+        {
+            while (i < len && p[i] >= 0x20 && p[i] < 0x7f)
+            {
+                if (p[i] == ':' && colon == no_colon)
+                    colon = i;
+                i++;
+            }
+            if (i < len && !scanOne(p, i, len, colon))
+                return ScanResult{no_colon, false};
+        }
+        return ScanResult{colon, true};
+    }
+
+#if defined(__x86_64__)
+    // SSE2没有字节查表指令，按块跳过可打印ASCII：整块都是可打印ASCII时只找':'，
+    // 否则从第一个需要检查的字节开始逐个字符处理，连续的多字节字符一起处理后再回到按块检查
+    // 需要检查的字节：小于0x20(按有符号比较，同时包含所有>=0x80的字节)、等于0x7f，\t除外
+    inline ScanResult scanSse2(const char *data, size_t len)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        const __m128i space = _mm_set1_epi8(0x20);
+        const __m128i del = _mm_set1_epi8(0x7f);
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i delim = _mm_set1_epi8(':');
+        size_t colon = no_colon;
+        size_t i = 0;
+        while (i + 16 <= len)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+            __m128i special = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+            special = _mm_andnot_si128(_mm_cmpeq_epi8(v, tab), special);
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+            uint32_t colons = colon == no_colon ? static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, delim))) : 0;
+            if (mask == 0)
+            {
+                if (colons)
+                    colon = i + __builtin_ctz(colons);
+                i += 16;
+                continue;
+            }
+
+            size_t first = __builtin_ctz(mask);
+            colons &= (1u << first) - 1;
+            if (colons)
+                colon = i + __builtin_ctz(colons);
+            i += first;
+            do
+            {
+                if (!scanOne(p, i, len, colon))
+                    return ScanResult{no_colon, false};
+            } while (i < len && p[i] >= 0x80);
+        }
+        return scanScalar(data, len, i, colon);
+    }
+
+    // AVX2按32字节一块完成全部检查，不回退到逐字节处理：
+    // UTF-8校验使用查表法(Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte")，
+    // 用前一个字节的高低4位和当前字节的高4位各查一次表，三个结果相与不为0即为错误，
+    // 第3、4个字节是否必须为后续字节由前2、3个字节判断
+    // C1控制字符为0xC2后跟0x80~0x9F，ASCII控制字符直接比较
+    namespace Utf8Lookup
+    {
+        const uint8_t too_short = 1 << 0;  // 11______ 0_______
+        const uint8_t too_long = 1 << 1;   // 0_______ 10______
+        const uint8_t overlong_3 = 1 << 2; // 11100000 100_____
+        const uint8_t too_large = 1 << 3;  // 11110100 1001____
+        const uint8_t surrogate = 1 << 4;  // 11101101 101_____
+        const uint8_t overlong_2 = 1 << 5; // 1100000_ 10______
+        const uint8_t too_large_1000 = 1 << 6; // 11110101 1000____
+        const uint8_t overlong_4 = 1 << 6;     // 11110000 1000____
+        const uint8_t two_conts = 1 << 7;      // 10______ 10______
+        const uint8_t carry = too_short | too_long | two_conts;
+
+        __attribute__((target("avx2"))) inline __m256i table(uint8_t t0, uint8_t t1, uint8_t t2, uint8_t t3, uint8_t t4, uint8_t t5, uint8_t t6, uint8_t t7,
+                                                            uint8_t t8, uint8_t t9, uint8_t t10, uint8_t t11, uint8_t t12, uint8_t t13, uint8_t t14, uint8_t t15)
+        {
+            return _mm256_setr_epi8(t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15,
+                                    t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15);
+        }
+
+        // 把上一块的末尾和当前块拼接后取前移n个字节的结果
+        template <int N>
+        __attribute__((target("avx2"))) inline __m256i prev(__m256i input, __m256i previous)
+        {
+            return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
+        }
+
+        __attribute__((target("avx2"))) inline __m256i high4(__m256i v)
+        {
+            return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+        }
+
+        // 当前块中所有字节对的错误标记
+        __attribute__((target("avx2"))) inline __m256i check(__m256i input, __m256i previous)
+        {
+            const __m256i byte_1_high = table(too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+                                              two_conts, two_conts, two_conts, two_conts,
+                                              too_short | overlong_2, too_short, too_short | overlong_3 | surrogate,
+                                              too_short | too_large | too_large_1000 | overlong_4);
+            const __m256i byte_1_low = table(carry | overlong_3 | overlong_2 | overlong_4, carry | overlong_2, carry, carry,
+                                             carry | too_large, carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                                             carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                                             carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                                             carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                                             carry | too_large | too_large_1000 | surrogate, carry | too_large | too_large_1000,
+                                             carry | too_large | too_large_1000);
+            const __m256i byte_2_high = table(too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+                                              too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+                                              too_long | overlong_2 | two_conts | overlong_3 | too_large,
+                                              too_long | overlong_2 | two_conts | surrogate | too_large,
+                                              too_long | overlong_2 | two_conts | surrogate | too_large,
+                                              too_short, too_short, too_short, too_short);
+
+            __m256i prev1 = prev<1>(input, previous);
+            __m256i special = _mm256_and_si256(_mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, high4(prev1)),
+                                                                _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+                                               _mm256_shuffle_epi8(byte_2_high, high4(input)));
+
+            // 前2个字节是3或4字节字符的首字节，或前3个字节是4字节字符的首字节时，当前字节必须是后续字节
+            __m256i third = _mm256_subs_epu8(prev<2>(input, previous), _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+            __m256i fourth = _mm256_subs_epu8(prev<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+            __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+            return _mm256_xor_si256(must23, special);
+        }
+
+        // 块的最后3个字节中有未结束的多字节字符时，下一块必须以后续字节开始
+        __attribute__((target("avx2"))) inline __m256i incomplete(__m256i input)
+        {
+            const __m256i max = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                 -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                 static_cast<char>(0xf0 - 1), static_cast<char>(0xe0 - 1), static_cast<char>(0xc0 - 1));
+            return _mm256_subs_epu8(input, max);
+        }
+    }
+
+    __attribute__((target("avx2"))) inline ScanResult scanAvx2(const char *data, size_t len)
+    {
+        const __m256i c0_max = _mm256_set1_epi8(0x1f);
+        const __m256i del = _mm256_set1_epi8(0x7f);
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i delim = _mm256_set1_epi8(':');
+        const __m256i lead_c2 = _mm256_set1_epi8(static_cast<char>(0xc2));
+        const __m256i c1_end = _mm256_set1_epi8(static_cast<char>(0xa0));
+
+        __m256i error = _mm256_setzero_si256();
+        __m256i previous = _mm256_setzero_si256();
+        __m256i pending = _mm256_setzero_si256(); // 上一块末尾未结束的字符
+        size_t colon = no_colon;
+        for (size_t i = 0; i < len; i += 32)
+        {
+            // 最后不足一块时补0，补的0对UTF-8校验来说是ASCII，控制字符和':'只看有效的字节
+            uint32_t valid = 0xffffffffu;
+            __m256i input;
+            if (len - i >= 32)
+                input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            else
+            {
+                alignas(32) char tail[32] = {0};
+                memcpy(tail, data + i, len - i);
+                input = _mm256_load_si256(reinterpret_cast<const __m256i *>(tail));
+                valid >>= 32 - (len - i);
+            }
+
+            __m256i control = _mm256_andnot_si256(_mm256_cmpeq_epi8(input, tab),
+                                                  _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(input, c0_max), input), _mm256_cmpeq_epi8(input, del)));
+            if (static_cast<uint32_t>(_mm256_movemask_epi8(control)) & valid)
+                return ScanResult{no_colon, false};
+
+            if (colon == no_colon)
+            {
+                uint32_t colons = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(input, delim))) & valid;
+                if (colons)
+                    colon = i + __builtin_ctz(colons);
+            }
+
+            // 整块都是ASCII时只需要确认上一块没有未结束的字符
+            if (_mm256_movemask_epi8(input) == 0)
+                error = _mm256_or_si256(error, pending);
+            else
+            {
+                error = _mm256_or_si256(error, Utf8Lookup::check(input, previous));
+                __m256i c1 = _mm256_and_si256(_mm256_cmpeq_epi8(Utf8Lookup::prev<1>(input, previous), lead_c2), _mm256_cmpgt_epi8(c1_end, input));
+                error = _mm256_or_si256(error, c1);
+                pending = Utf8Lookup::incomplete(input);
+            }
+            previous = input;
+        }
+        error = _mm256_or_si256(error, pending);
+
+        if (!_mm256_testz_si256(error, error))
+            return ScanResult{no_colon, false};
+        return ScanResult{colon, true};
+    }
+#endif
+
+    using scan_t = ScanResult (*)(const char *, size_t);
+
+    struct ScanKernel
+    {
+        const char *name;
+        scan_t scan;
+    };
+
+    // 按CPU支持的指令集选择实现，只在第一次使用时检测
+    inline const ScanKernel &scanKernel()
+    {
+        static const ScanKernel kernel = []()
+        {
+#if defined(__x86_64__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return ScanKernel{"avx2", scanAvx2};
+            return ScanKernel{"sse2", scanSse2};
+#else
+            return ScanKernel{"scalar", [](const char *data, size_t len)
+                              { return scanScalar(data, len); }};
+#endif
+        }();
+        return kernel;
+    }
+
+    inline ScanResult scanPayload(const char *data, size_t len)
+    {
+        return scanKernel().scan(data, len);
+    }
+
+    // 改写有问题的消息，返回out中第一个':'的位置，转义和替换的结果中不会出现':'
+    inline size_t sanitize(const char *data, size_t len, std::string &out)
+    {
+        static const char hex[] = "0123456789abcdef";
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        size_t colon = no_colon;
+        out.clear();
+        out.reserve(len + 16);
+        size_t i = 0;
+        while (i < len)
+        {
+            // 可打印ASCII成段拷贝
+            size_t run = i;
+            while (run < len && p[run] >= 0x20 && p[run] < 0x7f)
+            {
+                if (p[run] == ':' && colon == no_colon)
+                    colon = out.size() + (run - i);
+                run++;
+            }
+            out.append(data + i, run - i);
+            i = run;
+            if (i == len)
+                break;
+
+            unsigned char c = p[i];
+            uint32_t cp = c;
+            size_t n = 1;
+            if (c >= 0x80)
+            {
+                n = utf8Sequence(p, i, len, cp);
+                if (n == 0)
+                {
+                    // 无效字节逐个替换，之后的合法字符不受影响
+                    out += "\xef\xbf\xbd";
+                    i++;
+                    continue;
+                }
+            }
+
+            if (isControl(cp))
+            {
+                out += cp < 0x80 ? "\\x" : "\\u00";
+                out.push_back(hex[cp >> 4]);
+                out.push_back(hex[cp & 0xf]);
+            }
+            else
+            {
+                if (c == ':' && colon == no_colon)
+                    colon = out.size();
+                out.append(data + i, n);
+            }
+            i += n;
+        }
+        return colon;
+    }
+}
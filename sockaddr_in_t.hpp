@@ -74,6 +74,12 @@ namespace SockAddrInModule
             // return _ip == s._ip;
         }
 
+        // 返回struct sockaddr_in对象
+        const struct sockaddr_in &getAddr() const
+        {
+            return _s_addr_in;
+        }
+
         // 获取struct sockaddr_in对象长度
         socklen_t getLength()
         {
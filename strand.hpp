@@ -0,0 +1,122 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <functional>
+#include "mutex.hpp"
+
+namespace StrandModule
+{
+    using namespace MutexModule;
+
+    const size_t d_strands = 256; // 串行队列个数，键按哈希分配到队列
+
+    // 在线程池之上按键串行执行：同一个键的任务按提交顺序执行，不同键的任务并行执行
+    // 键按哈希映射到固定数量的串行队列，每个队列有自己的锁，不存在全局锁
+    // Executor需要提供push(std::function<void()>)，把任务交给线程池
+    template <class Executor>
+    class StrandExecutor
+    {
+    private:
+        struct Strand
+        {
+            Mutex lock;
+            std::vector<std::function<void()>> queue; // 等待执行的任务
+            bool running = false;                     // 是否已经有线程在执行该队列
+        };
+
+        // 在工作线程中执行队列中的任务，直到队列为空
+        static void drain(Strand &strand)
+        {
+            std::vector<std::function<void()>> batch;
+            while (true)
+            {
+                {
+                    MutexGuard guard(strand.lock);
+                    if (strand.queue.empty())
+                    {
+                        strand.running = false;
+                        return;
+                    }
+                    // 整批取出，执行期间新提交的任务不需要等待锁
+                    batch.swap(strand.queue);
+                }
+
+                for (auto &task : batch)
+                    task();
+                batch.clear();
+            }
+        }
+
+        // 乘法哈希打散地址中连续的端口
+        Strand &select(uint64_t key)
+        {
+            return *_strands[((key * 0x9E3779B97F4A7C15ULL) >> 32) % _strands.size()];
+        }
+
+    public:
+        StrandExecutor(Executor &executor, size_t strands = d_strands)
+            : _executor(executor), _strands(strands)
+        {
+            for (auto &s : _strands)
+                s = std::make_unique<Strand>();
+        }
+
+        StrandExecutor(const StrandExecutor &) = delete;
+        StrandExecutor &operator=(const StrandExecutor &) = delete;
+
+        // 提交任务，队列空闲时才向线程池提交一个执行任务
+        void post(uint64_t key, std::function<void()> task)
+        {
+            Strand &strand = select(key);
+            bool schedule = false;
+            {
+                MutexGuard guard(strand.lock);
+                strand.queue.push_back(std::move(task));
+                if (!strand.running)
+                {
+                    strand.running = true;
+                    schedule = true;
+                }
+            }
+
+            if (schedule)
+                _executor.push([&strand]()
+                               { drain(strand); });
+        }
+
+        // 队列空闲时在当前线程中直接执行，不经过线程池；队列中有任务时返回false，由调用方改为post
+        // 执行期间该队列视为忙，其他线程提交的任务排在后面，执行完后交给线程池
+        template <class F>
+        bool tryRun(uint64_t key, F &&task)
+        {
+            Strand &strand = select(key);
+            {
+                MutexGuard guard(strand.lock);
+                if (strand.running)
+                    return false;
+                strand.running = true;
+            }
+
+            task();
+
+            bool schedule = false;
+            {
+                MutexGuard guard(strand.lock);
+                if (strand.queue.empty())
+                    strand.running = false;
+                else
+                    schedule = true;
+            }
+            if (schedule)
+                _executor.push([&strand]()
+                               { drain(strand); });
+            return true;
+        }
+
+    private:
+        Executor &_executor;
+        std::vector<std::unique_ptr<Strand>> _strands;
+    };
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <time.h>
+#include "mutex.hpp"
+#include "log.hpp"
+
+namespace TraceModule
+{
+    using namespace MutexModule;
+    using namespace LogSystemModule;
+
+    // 消息经过的阶段边界，相邻两个边界之间为一个阶段
+    enum class TraceStage
+    {
+        Arrive = 0, // 内核收到报文(SO_TIMESTAMPNS)
+        Recv,       // recvmsg返回
+        Parse,      // 解析完成，得到发送者前缀
+        Enqueue,    // 分发任务提交到线程池
+        Start,      // 工作线程开始执行分发任务
+        Locked,     // 取得用户列表(UserManager的锁)
+        Sent,       // 发送循环结束
+        Count
+    };
+
+    const int trace_stages = static_cast<int>(TraceStage::Count);
+    // 阶段名，第i个阶段为边界i到边界i+1
+    const char *const trace_stage_names[trace_stages - 1] = {"recvfrom", "parse", "push", "queue", "lock", "send"};
+
+    const size_t d_trace_capacity = 16384;             // 每个线程最多保存的记录数，满后丢弃
+    const std::string d_trace_path = "./trace";        // 导出文件前缀：.json为Chrome trace，.csv为各阶段直方图
+    const int trace_buckets = 32;                      // 直方图按2的幂分桶，单位us
+
+    inline uint64_t traceNowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 一条被采样消息的各阶段时间戳，未经过的阶段为0
+    struct TraceSpan
+    {
+        uint64_t id = 0;
+        uint32_t recv_tid = 0; // 接收线程
+        uint32_t work_tid = 0; // 执行分发的线程
+        uint32_t chunk = 0;    // 分发任务的段号
+        uint64_t ts[trace_stages] = {0};
+
+        void mark(TraceStage stage) { ts[static_cast<int>(stage)] = traceNowNs(); }
+    };
+
+    // 单个线程的记录缓冲区，只有所属线程写入，导出时读取已发布的部分
+    struct TraceBuffer
+    {
+        uint32_t tid = 0;
+        std::unique_ptr<TraceSpan[]> spans = std::make_unique<TraceSpan[]>(d_trace_capacity);
+        std::atomic<size_t> count{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    // 采样追踪：接收线程按采样率决定是否追踪一条消息，之后各阶段写入时间戳，
+    // 分发任务结束时把记录写入当前线程的缓冲区，关闭采样时每条消息只多一次比较
+    class Tracer
+    {
+    private:
+        Tracer()
+            : _rate(0), _next_id(0), _next_tid(0)
+        {
+        }
+
+        TraceBuffer &local()
+        {
+            static thread_local std::shared_ptr<TraceBuffer> buffer;
+            if (!buffer)
+            {
+                buffer = std::make_shared<TraceBuffer>();
+                MutexGuard guard(_lock);
+                buffer->tid = _next_tid++;
+                _buffers.push_back(buffer);
+            }
+            return *buffer;
+        }
+
+        static TraceSpan *&current()
+        {
+            static thread_local TraceSpan *span = nullptr;
+            return span;
+        }
+
+    public:
+        Tracer(const Tracer &) = delete;
+        Tracer &operator=(const Tracer &) = delete;
+
+        static Tracer &getInstance()
+        {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        // 每rate条消息采样一条，0表示关闭，需要在服务器启动之前调用
+        void setRate(uint32_t rate)
+        {
+            _rate = rate;
+        }
+
+        bool isEnabled()
+        {
+            return _rate > 0;
+        }
+
+        // 是否追踪下一条消息，只在接收线程中调用
+        bool sample()
+        {
+            return _rate > 0 && ++_seen % _rate == 0;
+        }
+
+        // 为被采样的消息分配ID和接收线程
+        void begin(TraceSpan &span)
+        {
+            span.id = _next_id.fetch_add(1, std::memory_order_relaxed);
+            span.recv_tid = local().tid;
+        }
+
+        // 设置当前线程正在追踪的记录，下游模块通过mark写入，不需要传递参数
+        void setCurrent(TraceSpan *span)
+        {
+            current() = span;
+        }
+
+        static TraceSpan *getCurrent()
+        {
+            return current();
+        }
+
+        static void mark(TraceStage stage)
+        {
+            TraceSpan *span = current();
+            if (span)
+                span->mark(stage);
+        }
+
+        // 记录写入当前线程的缓冲区
+        void commit(const TraceSpan &span)
+        {
+            TraceBuffer &buffer = local();
+            size_t n = buffer.count.load(std::memory_order_relaxed);
+            if (n >= d_trace_capacity)
+            {
+                buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            buffer.spans[n] = span;
+            buffer.spans[n].work_tid = buffer.tid;
+            buffer.count.store(n + 1, std::memory_order_release);
+        }
+
+        // 导出所有线程的记录：path.json为Chrome trace-event格式，path.csv为各阶段耗时分布
+        void exportTo(const std::string &path)
+        {
+            std::vector<TraceSpan> spans;
+            uint64_t dropped = 0;
+            {
+                MutexGuard guard(_lock);
+                for (auto &b : _buffers)
+                {
+                    size_t n = b->count.load(std::memory_order_acquire);
+                    spans.insert(spans.end(), b->spans.get(), b->spans.get() + n);
+                    dropped += b->dropped.load(std::memory_order_relaxed);
+                }
+            }
+            if (spans.empty())
+            {
+                LOG(LogLevel::INFO) << "没有追踪记录";
+                return;
+            }
+
+            std::sort(spans.begin(), spans.end(), [](const TraceSpan &a, const TraceSpan &b)
+                      { return a.ts[static_cast<int>(TraceStage::Recv)] < b.ts[static_cast<int>(TraceStage::Recv)]; });
+            uint64_t base = UINT64_MAX;
+            for (auto &s : spans)
+                for (int i = 0; i < trace_stages; i++)
+                    if (s.ts[i] != 0)
+                        base = std::min(base, s.ts[i]);
+
+            // Chrome trace：每个阶段一个完整事件，接收线程的阶段和工作线程的阶段分别显示在各自的线程上
+            std::ofstream json(path + ".json");
+            json << "{\"traceEvents\":[\n";
+            bool first = true;
+            for (auto &s : spans)
+            {
+                for (int i = 0; i + 1 < trace_stages; i++)
+                {
+                    if (s.ts[i] == 0 || s.ts[i + 1] == 0 || s.ts[i + 1] < s.ts[i])
+                        continue;
+                    uint32_t tid = i < static_cast<int>(TraceStage::Enqueue) ? s.recv_tid : s.work_tid;
+                    json << (first ? "" : ",\n") << "{\"name\":\"" << trace_stage_names[i] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                         << ",\"ts\":" << (s.ts[i] - base) / 1000.0
+                         << ",\"dur\":" << (s.ts[i + 1] - s.ts[i]) / 1000.0
+                         << ",\"args\":{\"id\":" << s.id << ",\"chunk\":" << s.chunk << "}}";
+                    first = false;
+                }
+            }
+            json << "\n]}\n";
+
+            // 直方图：每个阶段一行，分位数为精确值，桶为le_Nus的计数
+            std::ofstream csv(path + ".csv");
+            csv << "stage,count,p50_us,p90_us,p99_us,max_us";
+            for (int b = 0; b < trace_buckets; b++)
+                csv << ",le_" << (1ULL << b) << "us";
+            csv << "\n";
+
+            for (int i = 0; i + 1 < trace_stages; i++)
+            {
+                std::vector<uint64_t> d;
+                for (auto &s : spans)
+                    if (s.ts[i] != 0 && s.ts[i + 1] >= s.ts[i])
+                        d.push_back(s.ts[i + 1] - s.ts[i]);
+                std::sort(d.begin(), d.end());
+
+                auto pct = [&d](double p)
+                {
+                    return d.empty() ? 0 : d[std::min(d.size() - 1, static_cast<size_t>(p * d.size()))] / 1000.0;
+                };
+                uint64_t hist[trace_buckets] = {0};
+                for (uint64_t ns : d)
+                {
+                    uint64_t us = ns / 1000;
+                    int b = us == 0 ? 0 : 64 - __builtin_clzll(us);
+                    hist[std::min(b, trace_buckets - 1)]++;
+                }
+
+                double max = d.empty() ? 0 : d.back() / 1000.0;
+                csv << trace_stage_names[i] << "," << d.size() << "," << pct(0.5) << "," << pct(0.9) << "," << pct(0.99) << "," << max;
+                for (int b = 0; b < trace_buckets; b++)
+                    csv << "," << hist[b];
+                csv << "\n";
+
+                LOG(LogLevel::INFO) << "阶段" << trace_stage_names[i] << "(us) 样本：" << d.size() << " p50：" << pct(0.5)
+                                    << " p99：" << pct(0.99) << " 最大：" << max;
+            }
+
+            LOG(LogLevel::INFO) << "追踪记录：" << spans.size() << " 丢弃：" << dropped << " 导出：" << path << ".json " << path << ".csv";
+        }
+
+        // 在工作线程中执行被追踪的任务，trace为空时直接执行
+        // 调用线程已有记录时(例如在接收线程中直接执行)，结束后恢复原来的记录
+        template <class F>
+        void run(const std::shared_ptr<const TraceSpan> &trace, uint32_t chunk, F &&f)
+        {
+            if (!trace)
+            {
+                f();
+                return;
+            }
+
+            TraceSpan span = *trace;
+            span.chunk = chunk;
+            span.mark(TraceStage::Start);
+            TraceSpan *outer = current();
+            setCurrent(&span);
+            f();
+            span.mark(TraceStage::Sent);
+            setCurrent(outer);
+            commit(span);
+        }
+
+    private:
+        Mutex _lock;
+        uint32_t _rate;
+        uint64_t _seen = 0; // 只在接收线程中修改
+        std::atomic<uint64_t> _next_id;
+        uint32_t _next_tid;
+        std::vector<std::shared_ptr<TraceBuffer>> _buffers;
+    };
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include "sockaddr_in_t.hpp"
+#include "errors.hpp"
+#include "log.hpp"
+#include "thread.hpp"
+#include "cookie.hpp"
+
+namespace UdpBotModule
+{
+    using namespace LogSystemModule;
+    using namespace SockAddrInModule;
+    using namespace ThreadModule;
+    using namespace CookieModule;
+
+    // 每次epoll_wait最多处理的事件数
+    const int d_max_events = 256;
+    // 发送节拍（毫秒）
+    const int d_tick_ms = 1;
+
+    // 获取纳秒时间戳
+    inline uint64_t nowNs(clockid_t clock = CLOCK_MONOTONIC)
+    {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    // 机器人运行参数
+    struct BotOptions
+    {
+        std::string ip;                   // 服务器IP
+        uint16_t port;                    // 服务器端口
+        uint32_t sessions = 100;          // 会话个数
+        int loops = 1;                    // 事件循环线程个数
+        double rate = 10;                 // 所有会话合计的发送速率（条/秒），0表示不发送
+        int duration = 10;                // 运行时长（秒）
+        std::string name_prefix = "bot";  // 会话名字前缀，名字为前缀+编号
+        std::vector<std::string> script;  // 发送脚本，每个会话按顺序循环发送
+        std::string record_path;          // 接收时间戳记录文件，为空时不记录
+    };
+
+    // 单个会话只保存必要的状态，名字按编号现场生成，便于支撑数万个会话
+    struct BotSession
+    {
+        int fd;              // 会话独占的套接字
+        uint32_t id;         // 会话编号
+        uint32_t script_pos; // 下一条要发送的脚本行
+        uint32_t sent;       // 已发送条数
+        uint32_t received;   // 已接收条数
+    };
+
+    // 一个epoll事件循环，负责一段连续编号的会话
+    class BotLoop
+    {
+    private:
+        void sendTo(BotSession &s, const std::string &text)
+        {
+            // 复用UdpClient的"名字:内容"协议
+            _buffer.clear();
+            _buffer += _opt.name_prefix;
+            _buffer += std::to_string(s.id);
+            _buffer += ':';
+            _buffer += text;
+
+            ssize_t ret = sendto(s.fd, _buffer.data(), _buffer.size(), 0, &_server, _server.getLength());
+            if (ret < 0)
+                _send_errors++;
+            else
+                s.sent++;
+        }
+
+        // 服务器回复cookie挑战后带着cookie重新上线，不计入发送和接收条数
+        void onChallenge(BotSession &s, const char *data, size_t len)
+        {
+            std::string online = cookieResponse(data, len, _opt.name_prefix + std::to_string(s.id) + ":online");
+            if (!online.empty())
+                sendto(s.fd, online.data(), online.size(), 0, &_server, _server.getLength());
+        }
+
+        // 按节拍发送，多个会话轮流发送以保持目标速率
+        void onTick(uint64_t start_ns)
+        {
+            uint64_t expirations = 0;
+            ssize_t n = read(_timerfd, &expirations, sizeof(expirations));
+            (void)n;
+
+            if (_rate <= 0 || _sessions.empty())
+                return;
+
+            double elapsed = (nowNs() - start_ns) / 1e9;
+            uint64_t due = static_cast<uint64_t>(elapsed * _rate);
+            const std::string default_text = "hello";
+            while (_total_sent < due)
+            {
+                BotSession &s = _sessions[_next];
+                _next = (_next + 1) % _sessions.size();
+
+                if (_opt.script.empty())
+                    sendTo(s, default_text);
+                else
+                {
+                    sendTo(s, _opt.script[s.script_pos]);
+                    s.script_pos = (s.script_pos + 1) % _opt.script.size();
+                }
+                _total_sent++;
+            }
+        }
+
+        // 读空套接字，记录每条消息的接收时间
+        void onReadable(BotSession &s)
+        {
+            char buffer[2048];
+            while (true)
+            {
+                ssize_t n = recv(s.fd, buffer, sizeof(buffer), 0);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    break;
+                }
+                if (isFrame(buffer, n, FrameType::Cookie))
+                {
+                    onChallenge(s, buffer, n);
+                    continue;
+                }
+
+                s.received++;
+                _total_received++;
+                if (_record)
+                    fprintf(_record, "%u,%llu,%zd\n", s.id, static_cast<unsigned long long>(nowNs(CLOCK_REALTIME)), n);
+            }
+        }
+
+        void run()
+        {
+            struct epoll_event events[d_max_events];
+            uint64_t start_ns = nowNs();
+            uint64_t end_ns = start_ns + static_cast<uint64_t>(_opt.duration) * 1000000000ull;
+
+            while (nowNs() < end_ns)
+            {
+                int n = epoll_wait(_epfd, events, d_max_events, 100);
+                for (int i = 0; i < n; i++)
+                {
+                    if (events[i].data.u64 == UINT64_MAX)
+                        onTick(start_ns);
+                    else
+                        onReadable(_sessions[events[i].data.u64]);
+                }
+            }
+
+            // 结束时通知服务器下线
+            for (auto &s : _sessions)
+                sendTo(s, "quit");
+        }
+
+    public:
+        BotLoop(const BotOptions &opt, uint32_t first_id, uint32_t count, double rate, FILE *record)
+            : _opt(opt), _server(opt.port, opt.ip), _rate(rate), _record(record), _epfd(-1), _timerfd(-1),
+              _next(0), _total_sent(0), _total_received(0), _send_errors(0),
+              _thread([this]()
+                      { run(); })
+        {
+            _epfd = epoll_create1(EPOLL_CLOEXEC);
+            _timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (_epfd < 0 || _timerfd < 0)
+            {
+                LOG(LogLevel::FATAL) << "epoll初始化失败：" << strerror(errno);
+                exit(static_cast<int>(ErrorNumber::SocketFail));
+            }
+
+            struct itimerspec its;
+            memset(&its, 0, sizeof(its));
+            its.it_value.tv_nsec = d_tick_ms * 1000000;
+            its.it_interval.tv_nsec = d_tick_ms * 1000000;
+            timerfd_settime(_timerfd, 0, &its, NULL);
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = UINT64_MAX;
+            epoll_ctl(_epfd, EPOLL_CTL_ADD, _timerfd, &ev);
+
+            _sessions.reserve(count);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                if (fd < 0)
+                {
+                    LOG(LogLevel::ERROR) << "会话创建失败：" << strerror(errno) << "，已创建：" << _sessions.size();
+                    break;
+                }
+
+                _sessions.push_back(BotSession{fd, first_id + i, 0, 0, 0});
+
+                ev.events = EPOLLIN;
+                ev.data.u64 = _sessions.size() - 1;
+                epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev);
+            }
+        }
+
+        // 所有会话先上线，再启动事件循环
+        void start()
+        {
+            for (auto &s : _sessions)
+                sendTo(s, "online");
+            _thread.start();
+        }
+
+        void join()
+        {
+            _thread.join();
+        }
+
+        uint64_t getSent()
+        {
+            uint64_t sent = 0;
+            for (auto &s : _sessions)
+                sent += s.sent;
+            return sent;
+        }
+
+        uint64_t getReceived()
+        {
+            return _total_received;
+        }
+
+        uint64_t getSendErrors()
+        {
+            return _send_errors;
+        }
+
+        size_t getSessionCount()
+        {
+            return _sessions.size();
+        }
+
+        ~BotLoop()
+        {
+            for (auto &s : _sessions)
+                close(s.fd);
+            if (_timerfd >= 0)
+                close(_timerfd);
+            if (_epfd >= 0)
+                close(_epfd);
+        }
+
+    private:
+        const BotOptions &_opt;
+        SockAddrIn _server;
+        double _rate;  // 本循环的发送速率
+        FILE *_record; // 接收时间戳记录文件
+        int _epfd;
+        int _timerfd;
+        std::vector<BotSession> _sessions;
+        size_t _next;             // 下一个发送的会话
+        uint64_t _total_sent;     // 按节拍累计的发送条数
+        uint64_t _total_received; // 累计接收条数
+        uint64_t _send_errors;    // 发送失败次数
+        std::string _buffer;      // 发送缓冲区，循环内复用
+        Thread _thread;
+    };
+
+    // 多会话机器人客户端，少量线程驱动大量会话
+    class UdpBot
+    {
+    public:
+        UdpBot(const BotOptions &opt)
+            : _opt(opt)
+        {
+            // 每个会话一个套接字，尽量提高文件描述符上限
+            struct rlimit rl;
+            if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+            {
+                rl.rlim_cur = rl.rlim_max;
+                setrlimit(RLIMIT_NOFILE, &rl);
+            }
+
+            int loops = _opt.loops > 0 ? _opt.loops : 1;
+            for (int i = 0; i < loops; i++)
+            {
+                FILE *record = NULL;
+                if (!_opt.record_path.empty())
+                {
+                    std::string path = _opt.record_path + "." + std::to_string(i);
+                    record = fopen(path.c_str(), "w");
+                    if (!record)
+                        LOG(LogLevel::WARNING) << "记录文件打开失败：" << path << " " << strerror(errno);
+                    else
+                        setvbuf(record, NULL, _IOFBF, 1 << 20);
+                }
+                _records.push_back(record);
+
+                // 均分会话
+                uint32_t first = _opt.sessions * i / loops;
+                uint32_t last = _opt.sessions * (i + 1) / loops;
+                _loops.push_back(std::make_unique<BotLoop>(_opt, first, last - first, _opt.rate / loops, record));
+            }
+        }
+
+        // 运行指定时长后返回
+        void run()
+        {
+            uint64_t start_ns = nowNs();
+            for (auto &loop : _loops)
+                loop->start();
+            for (auto &loop : _loops)
+                loop->join();
+            double elapsed = (nowNs() - start_ns) / 1e9;
+
+            uint64_t sessions = 0, sent = 0, received = 0, errors = 0;
+            for (auto &loop : _loops)
+            {
+                sessions += loop->getSessionCount();
+                sent += loop->getSent();
+                received += loop->getReceived();
+                errors += loop->getSendErrors();
+            }
+
+            LOG(LogLevel::INFO) << "会话：" << sessions << " 发送：" << sent << " 接收：" << received
+                                << " 发送失败：" << errors << " 接收速率：" << static_cast<uint64_t>(received / elapsed) << "条/秒";
+        }
+
+        ~UdpBot()
+        {
+            _loops.clear();
+            for (auto record : _records)
+                if (record)
+                    fclose(record);
+        }
+
+    private:
+        BotOptions _opt;
+        std::vector<std::unique_ptr<BotLoop>> _loops;
+        std::vector<FILE *> _records; // 每个事件循环一个记录文件，避免加锁
+    };
+
+    // 读取发送脚本，每行一条消息，忽略空行
+    inline std::vector<std::string> loadScript(const std::string &path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream in(path);
+        if (!in)
+        {
+            LOG(LogLevel::ERROR) << "脚本文件打开失败：" << path;
+            return lines;
+        }
+
+        std::string line;
+        while (getline(in, line))
+            if (!line.empty())
+                lines.push_back(line);
+        return lines;
+    }
+}
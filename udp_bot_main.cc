@@ -0,0 +1,64 @@
+#include "udp_bot.hpp"
+#include "log.hpp"
+#include <getopt.h>
+
+using namespace UdpBotModule;
+using namespace LogSystemModule;
+
+void usage(const char *proc)
+{
+    LOG(LogLevel::ERROR) << "错误使用，正确使用：" << proc
+                         << " [-c 会话个数] [-l 事件循环个数] [-r 合计发送速率(条/秒)] [-d 运行秒数]"
+                         << " [-f 发送脚本] [-o 接收记录文件前缀] [-n 名字前缀] IP 端口";
+}
+
+int main(int argc, char *argv[])
+{
+    BotOptions opt;
+
+    int c = 0;
+    while ((c = getopt(argc, argv, "c:l:r:d:f:o:n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'c':
+            opt.sessions = std::stoul(optarg);
+            break;
+        case 'l':
+            opt.loops = std::stoi(optarg);
+            break;
+        case 'r':
+            opt.rate = std::stod(optarg);
+            break;
+        case 'd':
+            opt.duration = std::stoi(optarg);
+            break;
+        case 'f':
+            opt.script = loadScript(optarg);
+            break;
+        case 'o':
+            opt.record_path = optarg;
+            break;
+        case 'n':
+            opt.name_prefix = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(4);
+        }
+    }
+
+    if (argc - optind != 2)
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+
+    opt.ip = argv[optind];
+    opt.port = std::stoi(argv[optind + 1]);
+
+    UdpBot bot(opt);
+    bot.run();
+
+    return 0;
+}
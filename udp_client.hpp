@@ -6,6 +6,14 @@
 #include "userInfo.hpp"
 #include "user.hpp"
 #include "thread.hpp"
+#include "protocol.hpp"
+#include "reliable.hpp"
+#include "fragment.hpp"
+#include "presence.hpp"
+#include "cookie.hpp"
+#include "mutex.hpp"
+#include <poll.h>
+#include <unistd.h>
 
 namespace UdpClientModule
 {
@@ -13,16 +21,108 @@ namespace UdpClientModule
     using namespace SockAddrInModule;
     using namespace UserManageModule;
     using namespace ThreadModule;
+    using namespace ProtocolModule;
+    using namespace ReliableModule;
+    using namespace FragmentModule;
+    using namespace PresenceModule;
+    using namespace CookieModule;
+    using namespace MutexModule;
 
     // 默认服务器端口和IP地址
     const std::string default_ip = "127.0.0.1";
     const uint16_t default_port = 8080;
 
+    // 大批量接收模式
+    const size_t d_recv_batch = 64;                  // 每次recvmmsg最多接收的报文数
+    const size_t d_recv_slot = 4096;                 // 单个报文的接收缓冲区，服务器发出的报文不超过一个分片
+    const int d_bulk_rcvbuf = 8 * 1024 * 1024;       // 套接字接收缓冲区
+    const int d_flush_ms = 20;                       // 输出最多缓存的时间
+    const size_t d_flush_bytes = 64 * 1024;          // 输出缓存超过该大小时立即写出
+    const std::string d_prompt = "请输入信息(@名字 内容 发送私信，/who 查看在线用户)：";
+    const std::string d_who_command = "/who";
+
+    // 批量输出：消息先写入缓冲区，按时间或大小一次写出，减少系统调用
+    // 输出到终端时先清除当前的输入提示，写完后重新显示，消息不会与提示交错
+    class OutputWriter
+    {
+    public:
+        OutputWriter(int fd = STDERR_FILENO)
+            : _fd(fd), _tty(isatty(fd)), _pending(0), _messages(0), _writes(0)
+        {
+        }
+
+        void append(const char *data, size_t len)
+        {
+            _buffer.append(data, len);
+            _buffer.push_back('\n');
+            _pending++;
+        }
+
+        bool empty()
+        {
+            return _pending == 0;
+        }
+
+        size_t size()
+        {
+            return _buffer.size();
+        }
+
+        void flush()
+        {
+            if (_pending == 0)
+                return;
+
+            std::string out;
+            out.reserve(_buffer.size() + d_prompt.size() + 8);
+            if (_tty)
+                out += "\r\033[K";
+            out += _buffer;
+            if (_tty)
+                out += d_prompt;
+
+            size_t off = 0;
+            while (off < out.size())
+            {
+                ssize_t ret = ::write(_fd, out.data() + off, out.size() - off);
+                if (ret < 0 && errno == EINTR)
+                    continue;
+                if (ret <= 0)
+                    break;
+                off += ret;
+            }
+
+            _messages += _pending;
+            _writes++;
+            _pending = 0;
+            _buffer.clear();
+        }
+
+        uint64_t getMessages()
+        {
+            return _messages;
+        }
+
+        uint64_t getWrites()
+        {
+            return _writes;
+        }
+
+    private:
+        int _fd;
+        bool _tty;
+        std::string _buffer;
+        size_t _pending;    // 缓冲区中的消息数
+        uint64_t _messages; // 已写出的消息数
+        uint64_t _writes;   // 写出次数，消息数/写出次数为平均合并的条数
+    };
+
     class UdpClient
     {
     public:
         UdpClient(std::string name, const std::string ip = default_ip, uint16_t port = default_port)
-            : _socketfd(-1), _isRunning(false), _sa_in(port, ip), _name(name)
+            : _socketfd(-1), _isRunning(false), _sa_in(port, ip), _name(name), _reliable(false), _group_fd(-1), _reassembler(d_max_message + d_max_overhead),
+              _bulk(false), _datagrams(0), _batches(0), _truncated(0)
         {
             _socketfd = socket(AF_INET, SOCK_DGRAM, 0);
 
@@ -46,7 +146,7 @@ namespace UdpClientModule
                          { getMessage(); });
                 t.start();
 
-                // 预先发送一条消息给服务器
+                // 预先发送一条消息给服务器，服务器回复cookie挑战后再正式上线
                 std::string online = _name + ":" + "online";
                 ssize_t ret = sendto(_socketfd, online.c_str(), online.size(), 0, &_sa_in, _sa_in.getLength());
 
@@ -55,16 +155,27 @@ namespace UdpClientModule
                 {
                     // 1.1 读取输入信息
                     std::string message;
-                    std::cout << "请输入信息：";
+                    std::cout << d_prompt;
                     getline(std::cin, message);
 
+                    // 查询在线列表，只请求本地版本之后的变更
+                    if (message == d_who_command)
+                    {
+                        queryPresence();
+                        continue;
+                    }
+
                     // 1.2 整合数据
                     std::string userinfo = _name + ":" + message;
 
                     // 1.3 发送数据
-                    ssize_t ret = sendto(_socketfd, userinfo.c_str(), userinfo.size(), 0, &_sa_in, _sa_in.getLength());
+                    if (userinfo.size() > d_max_message)
+                    {
+                        LOG(LogLevel::WARNING) << "消息过长：" << userinfo.size() << "，最大：" << d_max_message;
+                        continue;
+                    }
 
-                    if (ret < 0)
+                    if (!sendData(userinfo))
                         LOG(LogLevel::WARNING) << "Client send failed";
                 }
 
@@ -75,19 +186,361 @@ namespace UdpClientModule
         void getMessage()
         {
             // LOG(LogLevel::DEBUG) << "新线程启动";
+            if (_bulk)
+            {
+                receiveBulk();
+                return;
+            }
+
+            // 同时等待单播和组播套接字，可靠投递模式下定时醒来发送批量确认
+            struct pollfd fds[2];
+            fds[0].fd = _socketfd;
+            fds[0].events = POLLIN;
+            fds[1].fd = _group_fd;
+            fds[1].events = POLLIN;
+            nfds_t nfds = _group_fd >= 0 ? 2 : 1;
+            int timeout = _reliable ? d_ack_delay_ms : -1;
+
+            // 接收缓冲区不小于UDP最大报文，避免截断
+            std::unique_ptr<char[]> buffer = std::make_unique<char[]>(d_max_datagram);
+            while (true)
+            {
+                if (poll(fds, nfds, timeout) < 0 && errno != EINTR)
+                    break;
+
+                for (nfds_t i = 0; i < nfds; i++)
+                {
+                    if (!(fds[i].revents & POLLIN))
+                        continue;
+
+                    // 2. 回显服务器的信息
+                    struct sockaddr_in temp;
+                    socklen_t length = sizeof(temp);
+                    ssize_t n = recvfrom(fds[i].fd, buffer.get(), d_max_datagram, 0, reinterpret_cast<struct sockaddr *>(&temp), &length);
+
+                    if (n > 0)
+                        handleDatagram(buffer.get(), n, temp);
+                }
+
+                sendAck();
+            }
+        }
+
+        // 大批量接收：套接字就绪时用recvmmsg一次取出多个报文直到取空，消息写入输出缓冲区后按时间或大小批量写出
+        void receiveBulk()
+        {
+            struct pollfd fds[2];
+            fds[0].fd = _socketfd;
+            fds[0].events = POLLIN;
+            fds[1].fd = _group_fd;
+            fds[1].events = POLLIN;
+            nfds_t nfds = _group_fd >= 0 ? 2 : 1;
+
+            for (nfds_t i = 0; i < nfds; i++)
+            {
+                // 超过系统上限时SO_RCVBUFFORCE需要权限，失败后按上限设置
+                int size = d_bulk_rcvbuf;
+                if (setsockopt(fds[i].fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+                    setsockopt(fds[i].fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+                // 内核在每个报文上附带该套接字累计丢弃的报文数
+                int on = 1;
+                setsockopt(fds[i].fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+
+                socklen_t len = sizeof(size);
+                getsockopt(fds[i].fd, SOL_SOCKET, SO_RCVBUF, &size, &len);
+                LOG(LogLevel::INFO) << "大批量接收模式 接收缓冲区：" << size;
+            }
+
+            std::vector<char> buffers(d_recv_batch * d_recv_slot);
+            uint64_t last_flush = nowMs();
             while (true)
             {
-                // 2. 回显服务器的信息
-                struct sockaddr_in temp;
-                socklen_t length = sizeof(temp);
-                char buffer[1024] = {0};
-                ssize_t n = recvfrom(_socketfd, buffer, sizeof(buffer) - 1, 0, reinterpret_cast<struct sockaddr *>(&temp), &length);
+                // 有待输出的消息时最多等到下一次写出，可靠投递模式下还要定时发送确认
+                int timeout = -1;
+                if (!_out.empty())
+                    timeout = static_cast<int>(std::max<int64_t>(0, d_flush_ms - static_cast<int64_t>(nowMs() - last_flush)));
+                if (_reliable)
+                    timeout = timeout < 0 ? d_ack_delay_ms : std::min(timeout, d_ack_delay_ms);
 
-                if (n > 0)
-                    std::cerr << buffer << std::endl;
+                if (poll(fds, nfds, timeout) < 0 && errno != EINTR)
+                    break;
+
+                for (nfds_t i = 0; i < nfds; i++)
+                    if (fds[i].revents & POLLIN)
+                        drainSocket(i, buffers.data());
+
+                sendAck();
+
+                uint64_t now = nowMs();
+                if (_out.size() >= d_flush_bytes || (!_out.empty() && now - last_flush >= static_cast<uint64_t>(d_flush_ms)))
+                {
+                    reportDrops();
+                    _out.flush();
+                    last_flush = now;
+                }
             }
         }
 
+        // 取空一个套接字
+        void drainSocket(size_t index, char *buffers)
+        {
+            struct mmsghdr msgs[d_recv_batch];
+            struct iovec iovs[d_recv_batch];
+            struct sockaddr_in addrs[d_recv_batch];
+            char controls[d_recv_batch][CMSG_SPACE(sizeof(uint32_t))];
+
+            while (true)
+            {
+                // 每次调用前重新设置，内核会修改地址长度、控制信息长度和标志
+                for (size_t k = 0; k < d_recv_batch; k++)
+                {
+                    iovs[k].iov_base = buffers + k * d_recv_slot;
+                    iovs[k].iov_len = d_recv_slot;
+                    struct msghdr &hdr = msgs[k].msg_hdr;
+                    memset(&hdr, 0, sizeof(hdr));
+                    hdr.msg_name = &addrs[k];
+                    hdr.msg_namelen = sizeof(addrs[k]);
+                    hdr.msg_iov = &iovs[k];
+                    hdr.msg_iovlen = 1;
+                    hdr.msg_control = controls[k];
+                    hdr.msg_controllen = sizeof(controls[k]);
+                }
+
+                int n = recvmmsg(index == 0 ? _socketfd : _group_fd, msgs, d_recv_batch, MSG_DONTWAIT, NULL);
+                if (n <= 0)
+                    break;
+                _batches++;
+
+                for (int k = 0; k < n; k++)
+                {
+                    struct msghdr &hdr = msgs[k].msg_hdr;
+                    for (struct cmsghdr *c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c))
+                        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL)
+                            memcpy(&_kernel_drops[index], CMSG_DATA(c), sizeof(uint32_t));
+
+                    if (hdr.msg_flags & MSG_TRUNC)
+                    {
+                        _truncated++;
+                        continue;
+                    }
+                    _datagrams++;
+                    handleDatagram(static_cast<char *>(iovs[k].iov_base), msgs[k].msg_len, addrs[k]);
+                }
+
+                if (_out.size() >= d_flush_bytes)
+                {
+                    reportDrops();
+                    _out.flush();
+                }
+                if (static_cast<size_t>(n) < d_recv_batch)
+                    break;
+            }
+        }
+
+        // 内核丢弃数增加时在消息中提示
+        void reportDrops()
+        {
+            uint64_t drops = static_cast<uint64_t>(_kernel_drops[0]) + _kernel_drops[1];
+            if (drops == _reported_drops)
+                return;
+
+            std::string notice = "系统：接收缓冲区溢出，丢弃" + std::to_string(drops - _reported_drops) + "条消息";
+            _out.append(notice.data(), notice.size());
+            _reported_drops = drops;
+        }
+
+        void handleDatagram(const char *data, size_t len, const struct sockaddr_in &from)
+        {
+            if (isFrame(data, len, FrameType::PresenceUpdate))
+            {
+                onPresence(data, len);
+                return;
+            }
+            if (isFrame(data, len, FrameType::Cookie))
+            {
+                onChallenge(data, len);
+                return;
+            }
+
+            std::string message;
+            if (_reliable && isFrame(data, len, FrameType::ReliableData))
+            {
+                if (_receiver.onData(data, len, message))
+                    showMessage(message.data(), message.size(), from);
+            }
+            else
+                showMessage(data, len, from);
+        }
+
+        // 带着cookie重新发送上线消息
+        void onChallenge(const char *data, size_t len)
+        {
+            std::string online = cookieResponse(data, len, _name + ":" + "online");
+            if (online.empty())
+                return;
+            sendto(_socketfd, online.data(), online.size(), 0, &_sa_in, _sa_in.getLength());
+
+            // 开启可靠投递时告知服务器，请求同样带上cookie
+            if (_reliable)
+            {
+                std::string hello = cookieResponse(data, len, ReliableReceiver::helloFrame());
+                sendto(_socketfd, hello.data(), hello.size(), 0, &_sa_in, _sa_in.getLength());
+            }
+
+            // 加入组播组成功后告知服务器，之后广播只从组播组接收；失败时继续单播
+            // 在上线之后发送，服务器按顺序处理；同样带上cookie，服务器据此确认源地址
+            if (_group_fd >= 0)
+            {
+                std::string frame;
+                putFrameHead(frame, FrameType::MulticastJoin);
+                std::string join = cookieResponse(data, len, frame);
+                sendto(_socketfd, join.data(), join.size(), 0, &_sa_in, _sa_in.getLength());
+            }
+        }
+
+        void queryPresence()
+        {
+            std::string query;
+            {
+                MutexGuard guard(_presence_lock);
+                query = _roster.query();
+            }
+            sendto(_socketfd, query.data(), query.size(), 0, &_sa_in, _sa_in.getLength());
+        }
+
+        // 更新在线列表，回复完整后显示，收到不连续的增量时重新查询
+        void onPresence(const char *data, size_t len)
+        {
+            std::vector<std::string> users;
+            bool complete = false;
+            bool stale = false;
+            uint64_t version = 0;
+            {
+                MutexGuard guard(_presence_lock);
+                complete = _roster.apply(data, len);
+                stale = _roster.isStale();
+                version = _roster.getVersion();
+                if (complete)
+                    users = _roster.list();
+            }
+
+            if (stale)
+            {
+                queryPresence();
+                return;
+            }
+            if (!complete)
+                return;
+
+            std::string head = "在线用户(" + std::to_string(users.size()) + "，版本" + std::to_string(version) + ")：";
+            for (size_t i = 0; i < users.size(); i++)
+                head += (i ? "，" : "") + users[i];
+            output(head.data(), head.size());
+        }
+
+        void sendAck()
+        {
+            if (_reliable && _receiver.needAck())
+            {
+                std::string ack = _receiver.ackFrame();
+                sendto(_socketfd, ack.data(), ack.size(), 0, &_sa_in, _sa_in.getLength());
+            }
+        }
+
+        // 超长消息分片发送
+        bool sendData(const std::string &data)
+        {
+            if (!_fragmenter.needSplit(data.size()))
+                return sendto(_socketfd, data.c_str(), data.size(), 0, &_sa_in, _sa_in.getLength()) >= 0;
+
+            for (auto &frame : _fragmenter.split(data))
+                if (sendto(_socketfd, frame.data(), frame.size(), 0, &_sa_in, _sa_in.getLength()) < 0)
+                    return false;
+            return true;
+        }
+
+        // 显示消息，分片在重组完成后显示
+        void showMessage(const char *data, size_t len, const struct sockaddr_in &from)
+        {
+            if (isFrame(data, len, FrameType::Fragment))
+            {
+                std::string whole;
+                if (_reassembler.onFragment(data, len, from, whole))
+                    output(whole.data(), whole.size());
+                return;
+            }
+
+            output(data, len);
+        }
+
+        void output(const char *data, size_t len)
+        {
+            if (_bulk)
+                _out.append(data, len);
+            else
+                std::cerr << std::string(data, len) << std::endl;
+        }
+
+        // 开启大批量接收模式，需要在start之前调用
+        void enableBulkReceive()
+        {
+            _bulk = true;
+        }
+
+        // 大批量接收模式的统计
+        void printStats()
+        {
+            if (!_bulk)
+                return;
+            LOG(LogLevel::INFO) << "接收统计 报文：" << _datagrams << " recvmmsg次数：" << _batches
+                                << " 输出消息：" << _out.getMessages() << " 写出次数：" << _out.getWrites()
+                                << " 内核丢弃：" << static_cast<uint64_t>(_kernel_drops[0]) + _kernel_drops[1] << " 截断：" << _truncated;
+        }
+
+        // 开启可靠投递，需要在start之前调用
+        void enableReliable()
+        {
+            _reliable = true;
+        }
+
+        // 加入组播组，需要在start之前调用，失败时返回false并继续使用单播
+        bool enableMulticast(const std::string &group_ip, uint16_t group_port, const std::string &iface)
+        {
+            // 可靠投递需要逐个接收者的序号，不能与组播同时使用
+            if (_reliable)
+            {
+                LOG(LogLevel::WARNING) << "可靠投递模式下不使用组播";
+                return false;
+            }
+
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (fd < 0)
+            {
+                LOG(LogLevel::WARNING) << "创建组播套接字失败，使用单播：" << strerror(errno);
+                return false;
+            }
+
+            // 同一台机器上的多个客户端绑定同一个组播端口
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+            SockAddrIn local(group_port, group_ip);
+            struct ip_mreq mreq;
+            mreq.imr_multiaddr.s_addr = inet_addr(group_ip.c_str());
+            mreq.imr_interface.s_addr = iface.empty() ? htonl(INADDR_ANY) : inet_addr(iface.c_str());
+            if (bind(fd, &local, local.getLength()) < 0 ||
+                setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+            {
+                LOG(LogLevel::WARNING) << "加入组播组失败，使用单播：" << strerror(errno);
+                close(fd);
+                return false;
+            }
+
+            _group_fd = fd;
+            LOG(LogLevel::INFO) << "加入组播组：" << group_ip << ":" << group_port;
+            return true;
+        }
+
         std::string getName()
         {
             return _name;
@@ -108,6 +561,8 @@ namespace UdpClientModule
         {
             if (_isRunning)
                 close(_socketfd);
+            if (_group_fd >= 0)
+                close(_group_fd);
         }
 
         ~UdpClient()
@@ -120,5 +575,22 @@ namespace UdpClientModule
         SockAddrIn _sa_in;
         bool _isRunning;   // 标记客户端是否已经启动
         std::string _name; // 客户端名字
+
+        bool _reliable;             // 是否开启可靠投递
+        int _group_fd;              // 组播套接字，未加入组播时为-1
+        ReliableReceiver _receiver; // 可靠投递的去重和确认状态
+        Mutex _presence_lock;       // 输入线程发送查询，接收线程更新列表
+        PresenceRoster _roster;     // 本地在线列表
+        Fragmenter _fragmenter;     // 超长消息分片
+        Reassembler _reassembler;   // 分片重组，只在接收线程中使用
+
+        // 大批量接收模式，以下成员只在接收线程中使用
+        bool _bulk;                         // 是否开启大批量接收模式
+        OutputWriter _out;                  // 批量输出
+        uint64_t _datagrams;                // 收到的报文数
+        uint64_t _batches;                  // recvmmsg调用次数
+        uint64_t _truncated;                // 超过接收缓冲区被截断的报文数
+        uint32_t _kernel_drops[2] = {0, 0}; // 单播和组播套接字上内核累计丢弃的报文数
+        uint64_t _reported_drops = 0;       // 已经提示过的丢弃数
     };
 }
\ No newline at end of file
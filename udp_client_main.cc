@@ -3,6 +3,7 @@
 #include "user.hpp"
 #include <memory>
 #include <signal.h>
+#include <getopt.h>
 
 using namespace UdpClientModule;
 using namespace LogSystemModule;
@@ -14,6 +15,7 @@ void quit(int sig)
     (void)sig;
     std::string userinfo = (client->getName()) + ":" + "quit";
     int ret = sendto(client->getSocketfd(), userinfo.c_str(), userinfo.size(), 0, &(client->getSockAddrIn()), (client->getSockAddrIn()).getLength());
+    client->printStats();
     exit(0);
 }
 
@@ -22,15 +24,47 @@ int main(int argc, char *argv[])
     // 捕捉2号新号
     signal(2, quit);
 
+    bool reliable = false;
+    bool bulk = false;
+    std::string group;
+    std::string group_iface;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "rg:G:B")) != -1)
+    {
+        if (opt == 'r')
+            reliable = true;
+        else if (opt == 'g')
+            group = optarg;
+        else if (opt == 'G')
+            group_iface = optarg;
+        else if (opt == 'B')
+            bulk = true;
+    }
+
+    if (argc - optind != 3)
+    {
+        LOG(LogLevel::ERROR) << "错误使用，正确使用：" << argv[0] << " [-r(开启可靠投递)] [-g 组播组ip:port] [-G 组播接收地址] [-B(大批量接收模式)] IP 端口 名字";
+        exit(4);
+    }
+
     // 获取到用户输入的端口和IP地址
-    std::string ip = argv[1];
-    uint16_t port = std::stoi(argv[2]);
+    std::string ip = argv[optind];
+    uint16_t port = std::stoi(argv[optind + 1]);
 
     // 获取用户名字
-    std::string name = argv[3];
+    std::string name = argv[optind + 2];
 
     // 创建客户端对象——用户自定义端口和IP地址
     client = std::make_shared<UdpClient>(name, ip, port);
+    if (reliable)
+        client->enableReliable();
+    if (bulk)
+        client->enableBulkReceive();
+
+    // 组播失败时继续使用单播
+    size_t colon = group.rfind(':');
+    if (colon != std::string::npos)
+        client->enableMulticast(group.substr(0, colon), std::stoi(group.substr(colon + 1)), group_iface);
 
     // 启动客户端
     client->start();
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "sockaddr_in_t.hpp"
+#include "errors.hpp"
+#include "log.hpp"
+
+namespace UdpProxyModule
+{
+    using namespace SockAddrInModule;
+    using namespace LogSystemModule;
+
+    const int d_max_events = 64;
+
+    // 按比例随机丢包的UDP代理，用于在本机模拟有损网络
+    // 每个客户端地址对应一个上游套接字，服务器看到的是代理的地址
+    class LossyProxy
+    {
+    private:
+        struct Client
+        {
+            struct sockaddr_in addr; // 客户端地址
+            int upstream;            // 发往服务器的套接字
+        };
+
+        static uint64_t addrKey(const struct sockaddr_in &addr)
+        {
+            return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+        }
+
+        bool drop()
+        {
+            return _loss > 0 && _dist(_rng) < _loss;
+        }
+
+        // 客户端 -> 服务器
+        void onDownstream()
+        {
+            char buffer[65536];
+            while (true)
+            {
+                struct sockaddr_in peer;
+                socklen_t length = sizeof(peer);
+                ssize_t n = recvfrom(_listenfd, buffer, sizeof(buffer), 0, reinterpret_cast<struct sockaddr *>(&peer), &length);
+                if (n < 0)
+                    break;
+
+                auto it = _clients.find(addrKey(peer));
+                if (it == _clients.end())
+                {
+                    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+                    if (fd < 0 || connect(fd, &_upstream, _upstream.getLength()) < 0)
+                    {
+                        LOG(LogLevel::WARNING) << "上游套接字创建失败：" << strerror(errno);
+                        if (fd >= 0)
+                            close(fd);
+                        continue;
+                    }
+
+                    struct epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.fd = fd;
+                    epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev);
+
+                    it = _clients.emplace(addrKey(peer), Client{peer, fd}).first;
+                    _by_fd[fd] = it->first;
+                }
+
+                if (drop())
+                {
+                    _dropped_up++;
+                    continue;
+                }
+                send(it->second.upstream, buffer, n, 0);
+                _forwarded_up++;
+            }
+        }
+
+        // 服务器 -> 客户端
+        void onUpstream(int fd)
+        {
+            auto key = _by_fd.find(fd);
+            if (key == _by_fd.end())
+                return;
+            const Client &client = _clients[key->second];
+
+            char buffer[65536];
+            while (true)
+            {
+                ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n < 0)
+                    break;
+
+                if (drop())
+                {
+                    _dropped_down++;
+                    continue;
+                }
+                sendto(_listenfd, buffer, n, 0, reinterpret_cast<const struct sockaddr *>(&client.addr), sizeof(client.addr));
+                _forwarded_down++;
+            }
+        }
+
+    public:
+        LossyProxy(uint16_t listen_port, const std::string &server_ip, uint16_t server_port, double loss, unsigned seed)
+            : _listen(listen_port), _upstream(server_port, server_ip), _loss(loss), _rng(seed), _dist(0.0, 1.0),
+              _isRunning(false), _forwarded_up(0), _forwarded_down(0), _dropped_up(0), _dropped_down(0)
+        {
+            _listenfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            _epfd = epoll_create1(0);
+            if (_listenfd < 0 || _epfd < 0)
+            {
+                LOG(LogLevel::FATAL) << "Proxy initiate error: " << strerror(errno);
+                exit(static_cast<int>(ErrorNumber::SocketFail));
+            }
+
+            if (bind(_listenfd, &_listen, _listen.getLength()) < 0)
+            {
+                LOG(LogLevel::FATAL) << "Bind error" << strerror(errno);
+                exit(static_cast<int>(ErrorNumber::BindSocketFail));
+            }
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = _listenfd;
+            epoll_ctl(_epfd, EPOLL_CTL_ADD, _listenfd, &ev);
+
+            LOG(LogLevel::INFO) << "Proxy " << listen_port << " -> " << server_ip << ":" << server_port << " 丢包率：" << loss;
+        }
+
+        void start()
+        {
+            _isRunning = true;
+            struct epoll_event events[d_max_events];
+            while (_isRunning)
+            {
+                int n = epoll_wait(_epfd, events, d_max_events, -1);
+                for (int i = 0; i < n; i++)
+                {
+                    if (events[i].data.fd == _listenfd)
+                        onDownstream();
+                    else
+                        onUpstream(events[i].data.fd);
+                }
+            }
+
+            LOG(LogLevel::INFO) << "上行转发：" << _forwarded_up << " 上行丢弃：" << _dropped_up
+                                << " 下行转发：" << _forwarded_down << " 下行丢弃：" << _dropped_down;
+        }
+
+        // 可以在信号处理函数中调用
+        void stop()
+        {
+            _isRunning = false;
+        }
+
+        ~LossyProxy()
+        {
+            for (auto &item : _clients)
+                close(item.second.upstream);
+            close(_listenfd);
+            close(_epfd);
+        }
+
+    private:
+        int _listenfd;
+        int _epfd;
+        SockAddrIn _listen;
+        SockAddrIn _upstream; // 服务器地址
+        double _loss;         // 丢包率 [0, 1)
+        std::mt19937 _rng;
+        std::uniform_real_distribution<double> _dist;
+        volatile bool _isRunning;
+
+        std::unordered_map<uint64_t, Client> _clients; // 客户端地址 -> 上游套接字
+        std::unordered_map<int, uint64_t> _by_fd;      // 上游套接字 -> 客户端地址
+
+        uint64_t _forwarded_up;
+        uint64_t _forwarded_down;
+        uint64_t _dropped_up;
+        uint64_t _dropped_down;
+    };
+}
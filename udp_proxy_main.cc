@@ -0,0 +1,69 @@
+#include "udp_proxy.hpp"
+#include "log.hpp"
+#include <memory>
+#include <signal.h>
+#include <getopt.h>
+
+using namespace UdpProxyModule;
+using namespace LogSystemModule;
+
+std::shared_ptr<LossyProxy> proxy;
+
+void quit(int sig)
+{
+    (void)sig;
+    if (proxy)
+        proxy->stop();
+}
+
+void usage(const char *proc)
+{
+    LOG(LogLevel::ERROR) << "错误使用，正确使用：" << proc << " [-L 丢包率(0~1)] [-S 随机种子] 监听端口 服务器IP 服务器端口";
+}
+
+int main(int argc, char *argv[])
+{
+    double loss = 0.1;
+    unsigned seed = 1;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "L:S:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'L':
+            loss = std::stod(optarg);
+            break;
+        case 'S':
+            seed = std::stoul(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(4);
+        }
+    }
+
+    if (argc - optind != 3)
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+
+    uint16_t listen_port = std::stoi(argv[optind]);
+    std::string server_ip = argv[optind + 1];
+    uint16_t server_port = std::stoi(argv[optind + 2]);
+
+    proxy = std::make_shared<LossyProxy>(listen_port, server_ip, server_port, loss, seed);
+
+    // 不设置SA_RESTART使epoll_wait被打断后输出统计
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = quit;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    proxy->start();
+
+    return 0;
+}
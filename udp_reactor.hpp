@@ -0,0 +1,479 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string.h>
+#include <sys/socket.h>
+#include "udp_server.hpp"
+#include "reactor.hpp"
+#include "thread.hpp"
+
+using user_list_ptr_t = std::shared_ptr<const RecipientModule::recipient_list_t>;
+using fetch_users_t = std::function<user_list_ptr_t()>;
+using find_name_t = std::function<RecipientModule::recipient_list_t(const std::string &)>;
+
+namespace UdpReactorModule
+{
+    using namespace UdpServerModule;
+    using namespace ReactorModule;
+    using namespace ThreadModule;
+
+    const size_t d_reactor_loops = 2;  // 默认事件循环线程数
+    const size_t d_inline_users = 64;  // 用户数不超过该值时在接收协程中直接发送
+    const size_t d_yield_users = 256;  // 大房间每发送给多少个用户让出一次事件循环
+    const size_t d_max_outbox = 4096;  // 每个事件循环等待分发协程发送的消息上限，超过时丢弃新消息
+
+    // 待发送的消息，target不为空时为私信
+    struct Outgoing
+    {
+        prefix_ptr_t prefix;
+        MessageRef message;
+        std::string target;
+        struct sockaddr_in from;
+    };
+
+    // 一个事件循环线程的全部状态，只在该线程中访问
+    struct ReactorWorker
+    {
+        EventLoop loop;
+        int sockfd = -1;
+        Reassembler reassembler;
+        std::deque<Outgoing> outbox; // 交给分发协程的消息，按接收顺序发送
+        bool draining = false;       // 分发协程是否在运行
+
+        uint64_t received = 0;    // 收到的报文数
+        uint64_t sent = 0;        // 发出的报文数
+        uint64_t inline_msgs = 0; // 在接收协程中直接发送的消息数
+        uint64_t queued_msgs = 0; // 交给分发协程的消息数
+        uint64_t suspended = 0;   // 发送缓冲区满挂起的次数
+        uint64_t sanitized = 0;   // 改写过的消息数
+        uint64_t dropped = 0;     // 等待发送的消息达到上限时丢弃的消息数
+
+        ReactorWorker(size_t max_message)
+            : reassembler(max_message + d_max_overhead)
+        {
+        }
+    };
+
+    // 协程引擎：每个事件循环线程有一个绑定到同一端口的套接字(SO_REUSEPORT)，
+    // 内核按来源地址选择套接字，同一个客户端的报文总是由同一个事件循环处理，不需要线程交接也能保持顺序
+    // 接收、解析、成员变更和分发都在事件循环中以协程执行，发送缓冲区满时挂起而不是阻塞线程
+    // 只支持聊天、上下线、私信和分片重组，多节点转发、可靠投递、组播和抓包使用UdpServer
+    class UdpReactorServer : public NoCopy
+    {
+    private:
+        int openSocket()
+        {
+            int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sockfd < 0)
+            {
+                LOG(LogLevel::FATAL) << "Server initiate error：" << strerror(errno);
+                exit(static_cast<int>(ErrorNumber::SocketFail));
+            }
+
+            int on = 1;
+            setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+            if (bind(sockfd, &_sa_in, _sa_in.getLength()) < 0)
+            {
+                LOG(LogLevel::FATAL) << "Bind error" << strerror(errno);
+                exit(static_cast<int>(ErrorNumber::BindSocketFail));
+            }
+            return sockfd;
+        }
+
+        // 接收协程：没有报文时挂起等待可读，每个报文处理完后再接收下一个
+        Task receive(ReactorWorker &w)
+        {
+            std::unique_ptr<char[]> buffer = std::make_unique<char[]>(d_max_datagram);
+            while (!w.loop.isStopped())
+            {
+                struct sockaddr_in peer;
+                socklen_t length = sizeof(peer);
+                ssize_t ret = recvfrom(w.sockfd, buffer.get(), d_max_datagram, MSG_DONTWAIT, reinterpret_cast<struct sockaddr *>(&peer), &length);
+                if (ret < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        co_await w.loop.readable(w.sockfd);
+                    continue;
+                }
+
+                w.received++;
+                if (ret > 0)
+                    co_await handleDatagram(w, buffer.get(), ret, peer);
+            }
+        }
+
+        Step handleDatagram(ReactorWorker &w, const char *data, size_t len, const struct sockaddr_in &peer)
+        {
+            if (isFrame(data, len, FrameType::Fragment))
+            {
+                std::string whole;
+                if (w.reassembler.onFragment(data, len, peer, whole) && !whole.empty() && whole[0] != frame_magic)
+                    co_await handleMessage(w, whole.data(), whole.size(), peer);
+                co_return;
+            }
+
+            // 在线列表查询，只回复已上线的地址，回复在接收协程中直接发送
+            uint32_t epoch = 0;
+            uint64_t version = 0;
+            if (_presence_query && parsePresenceQuery(data, len, epoch, version))
+            {
+                std::vector<std::string> frames = _presence_query(peer, epoch, version);
+                for (auto &frame : frames)
+                    co_await sendBatch(w, std::string_view(), frame, &peer, 1);
+                co_return;
+            }
+
+            // 带cookie的上线回复，验证通过后按普通消息处理
+            if (isFrame(data, len, FrameType::Cookie))
+            {
+                const char *payload = nullptr;
+                size_t payload_len = 0;
+                if (_cookies.verify(data, len, peer, payload, payload_len))
+                    co_await handleMessage(w, payload, payload_len, peer, true);
+                co_return;
+            }
+
+            // 其余控制帧属于本引擎不支持的功能
+            if (len > 0 && data[0] == frame_magic)
+                co_return;
+
+            co_await handleMessage(w, data, len, peer);
+        }
+
+        // 处理"名字:内容"格式的聊天消息，verified表示源地址已经通过cookie验证
+        Step handleMessage(ReactorWorker &w, const char *data, size_t len, const struct sockaddr_in &peer, bool verified = false)
+        {
+            // 有问题的消息改写到协程帧中的字符串，之后的挂起不影响它的生命周期
+            std::string sanitized;
+            ScanResult scan = scanPayload(data, len);
+            if (!scan.clean)
+            {
+                scan.colon = sanitize(data, len, sanitized);
+                data = sanitized.data();
+                len = sanitized.size();
+                w.sanitized++;
+            }
+
+            const char *colon = scan.colon == no_colon ? nullptr : data + scan.colon;
+            std::string name(data, colon ? colon - data : len);
+            const char *body = colon ? colon + 1 : data;
+            std::string_view message(body, data + len - body);
+
+            if (message.size() == 0)
+                co_return;
+
+            Outgoing out;
+            out.from = peer;
+
+            // 成员变更直接在事件循环中执行，用户列表的锁只在复制列表时持有
+            if (message == "quit" || message == "online")
+            {
+                // 未验证的上线只回复cookie挑战，不分配任何状态
+                if (message == "online" && !verified)
+                {
+                    std::string challenge = _cookies.challenge(peer);
+                    co_await sendBatch(w, std::string_view(), challenge, &peer, 1);
+                    co_return;
+                }
+
+                SockAddrIn netUser(peer);
+                User user(netUser.getPort(), netUser.getIp(), name);
+                std::string_view text;
+                if (message == "online")
+                {
+                    _addUser(user);
+                    out.prefix = user.getPrefix();
+                    text = "online";
+                }
+                else
+                {
+                    _delUser(user);
+                    out.prefix = std::make_shared<const std::string>(user.getName() + " (" + netUser.getIp() + ":" + std::to_string(netUser.getPort()) + ")");
+                    text = " offline";
+                }
+                out.message = MessageRef(text.data(), text.size());
+                co_await dispatch(w, std::move(out));
+                co_return;
+            }
+
+            if (_find_prefix)
+                out.prefix = _find_prefix(peer, name);
+            if (!out.prefix)
+            {
+                SockAddrIn netUser(peer);
+                out.prefix = std::make_shared<const std::string>(User::formatPrefix(name, netUser.getIp(), netUser.getPort()));
+            }
+
+            // "@名字 内容"为私信
+            if (_find_name && message.size() > 1 && message[0] == '@')
+            {
+                size_t space = message.find(' ');
+                std::string target(message.substr(1, space == std::string_view::npos ? std::string_view::npos : space - 1));
+                std::string_view text = space == std::string_view::npos ? std::string_view() : message.substr(space + 1);
+                if (!target.empty() && !text.empty())
+                {
+                    std::string marked = d_direct_mark;
+                    marked.append(text.data(), text.size());
+                    out.target = target;
+                    out.message = MessageRef(marked.data(), marked.size());
+                    co_await dispatch(w, std::move(out));
+                    co_return;
+                }
+            }
+
+            out.message = MessageRef(message.data(), message.size());
+            co_await dispatch(w, std::move(out));
+        }
+
+        // 小房间和私信在接收协程中直接发送，大房间交给分发协程分段发送，接收不被长时间占用
+        // 分发协程运行期间所有消息都排在它后面，接收者看到的顺序与接收顺序一致
+        Step dispatch(ReactorWorker &w, Outgoing out)
+        {
+            if (!w.draining)
+            {
+                user_list_ptr_t users = out.target.empty() ? _fetch_users() : nullptr;
+                if (!users || users->size() <= d_inline_users)
+                {
+                    w.inline_msgs++;
+                    co_await deliver(w, out, users, false);
+                    co_return;
+                }
+            }
+
+            // 发送一直跟不上时丢弃新消息，不让等待队列无限增长
+            if (w.outbox.size() >= d_max_outbox)
+            {
+                w.dropped++;
+                co_return;
+            }
+
+            w.queued_msgs++;
+            w.outbox.push_back(std::move(out));
+            if (!w.draining)
+                drain(w);
+        }
+
+        Task drain(ReactorWorker &w)
+        {
+            w.draining = true;
+            while (!w.outbox.empty() && !w.loop.isStopped())
+            {
+                // 发送完成后再出队，deque尾部插入不影响队首元素的引用
+                Outgoing &out = w.outbox.front();
+                user_list_ptr_t users;
+                if (out.target.empty())
+                    users = _fetch_users();
+                co_await deliver(w, out, users, true);
+                w.outbox.pop_front();
+            }
+            w.draining = false;
+        }
+
+        Step deliver(ReactorWorker &w, const Outgoing &out, user_list_ptr_t users, bool yield)
+        {
+            std::string_view message = out.message.view();
+
+            if (!out.target.empty())
+            {
+                recipient_list_t targets = _find_name(out.target);
+                if (targets.empty())
+                {
+                    std::string reply = "系统：用户" + out.target + "不在线";
+                    co_await sendFrames(w, std::string_view(), reply, &out.from, 1);
+                    co_return;
+                }
+
+                co_await sendFrames(w, *out.prefix, message, targets.data(), targets.size());
+                co_return;
+            }
+
+            // 快照中的地址连续存放，按段直接发送
+            for (size_t first = 0; first < users->size() && !w.loop.isStopped(); first += d_yield_users)
+            {
+                size_t last = std::min(users->size(), first + d_yield_users);
+                co_await sendFrames(w, *out.prefix, message, users->data() + first, last - first);
+                if (yield)
+                    co_await w.loop.yield();
+            }
+        }
+
+        // 向count个地址发送"前缀+消息"，超长时切分后发送
+        Step sendFrames(ReactorWorker &w, std::string_view prefix, std::string_view message, const struct sockaddr_in *addrs, size_t count)
+        {
+            if (_fragmenter.needSplit(prefix.size() + message.size()))
+            {
+                std::string whole(prefix);
+                whole.append(message.data(), message.size());
+                std::vector<std::string> frames = _fragmenter.split(whole);
+                for (auto &frame : frames)
+                    co_await sendBatch(w, std::string_view(), frame, addrs, count);
+                co_return;
+            }
+
+            co_await sendBatch(w, prefix, message, addrs, count);
+        }
+
+        // 前缀和消息作为两段iovec批量发送，发送缓冲区满时挂起等待可写
+        Step sendBatch(ReactorWorker &w, std::string_view prefix, std::string_view message, const struct sockaddr_in *addrs, size_t count)
+        {
+            struct iovec iov[2];
+            iov[0].iov_base = const_cast<char *>(prefix.data());
+            iov[0].iov_len = prefix.size();
+            iov[1].iov_base = const_cast<char *>(message.data());
+            iov[1].iov_len = message.size();
+
+            struct mmsghdr msgs[max_send_batch];
+            size_t batch = _send_batch.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count;)
+            {
+                size_t n = std::min(batch, count - i);
+                for (size_t k = 0; k < n; k++)
+                {
+                    struct msghdr &hdr = msgs[k].msg_hdr;
+                    memset(&hdr, 0, sizeof(hdr));
+                    hdr.msg_name = const_cast<struct sockaddr_in *>(addrs + i + k);
+                    hdr.msg_namelen = sizeof(struct sockaddr_in);
+                    hdr.msg_iov = iov;
+                    hdr.msg_iovlen = 2;
+                }
+
+                size_t sent = 0;
+                while (sent < n)
+                {
+                    int ret = sendmmsg(w.sockfd, msgs + sent, n - sent, MSG_DONTWAIT);
+                    if (ret >= 0)
+                    {
+                        sent += ret;
+                        continue;
+                    }
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        if (w.loop.isStopped())
+                            co_return;
+                        w.suspended++;
+                        co_await w.loop.writable(w.sockfd);
+                        continue;
+                    }
+
+                    // 跳过发送失败的消息
+                    const struct sockaddr_in *addr = static_cast<const struct sockaddr_in *>(msgs[sent].msg_hdr.msg_name);
+                    LOG(LogLevel::WARNING) << "send message failed: " << strerror(errno) << " to: " << SockAddrIn(*addr).getIp() << ":" << ntohs(addr->sin_port);
+                    sent++;
+                }
+                w.sent += n;
+                i += n;
+            }
+        }
+
+        void runWorker(ReactorWorker &w)
+        {
+            receive(w);
+            w.loop.run();
+        }
+
+    public:
+        UdpReactorServer(add_user_t addUser, del_user_t delUser, fetch_users_t fetchUsers, uint16_t port = default_port,
+                         size_t max_message = d_max_message, size_t loops = d_reactor_loops)
+            : _sa_in(port), _addUser(addUser), _delUser(delUser), _fetch_users(fetchUsers)
+        {
+            for (size_t i = 0; i < std::max<size_t>(1, loops); i++)
+            {
+                _workers.push_back(std::make_unique<ReactorWorker>(max_message));
+                _workers.back()->sockfd = openSocket();
+            }
+
+            LOG(LogLevel::INFO) << "Server initiated：协程引擎 事件循环数：" << _workers.size() << " 消息校验：" << scanKernel().name;
+        }
+
+        // 启动服务器，第一个事件循环在当前线程中运行，stop后所有事件循环退出时返回
+        void start()
+        {
+            std::vector<std::unique_ptr<Thread>> threads;
+            for (size_t i = 1; i < _workers.size(); i++)
+            {
+                ReactorWorker *w = _workers[i].get();
+                threads.push_back(std::make_unique<Thread>([this, w]()
+                                                           { runWorker(*w); }));
+                threads.back()->start();
+            }
+
+            runWorker(*_workers[0]);
+
+            for (auto &t : threads)
+                t->join();
+        }
+
+        // 设置发送者前缀的查找方式，需要在start之前调用
+        void setPrefixLookup(find_prefix_t find_prefix)
+        {
+            _find_prefix = find_prefix;
+        }
+
+        // 启用"@名字 内容"格式的私信，需要在start之前调用
+        void setDirectMessage(find_name_t find_name)
+        {
+            _find_name = find_name;
+        }
+
+        // 启用在线列表查询，需要在start之前调用
+        void setPresence(presence_query_t presence_query)
+        {
+            _presence_query = presence_query;
+        }
+
+        // 设置每次sendmmsg最多发送的消息数，运行中可以调用
+        void setSendBatch(size_t batch)
+        {
+            _send_batch.store(std::clamp<size_t>(batch, 1, max_send_batch), std::memory_order_relaxed);
+        }
+
+        // 设置所有事件循环套接字的收发缓冲区，0表示不修改，运行中可以调用
+        void setSocketBuffers(int recv_buffer, int send_buffer)
+        {
+            for (auto &w : _workers)
+                applySocketBuffers(w->sockfd, recv_buffer, send_buffer);
+        }
+
+        // 停止服务器，可以在信号处理函数中调用
+        void stop()
+        {
+            for (auto &w : _workers)
+                w->loop.stop();
+        }
+
+        ~UdpReactorServer()
+        {
+            for (size_t i = 0; i < _workers.size(); i++)
+            {
+                ReactorWorker &w = *_workers[i];
+                LOG(LogLevel::INFO) << "事件循环" << i << " 收到：" << w.received << " 发出：" << w.sent
+                                    << " 直接发送：" << w.inline_msgs << " 排队发送：" << w.queued_msgs
+                                    << " 未发送：" << w.outbox.size() << " 丢弃：" << w.dropped << " 发送挂起：" << w.suspended << " 改写：" << w.sanitized;
+                w.reassembler.printStats();
+                close(w.sockfd);
+            }
+            MessagePool::getInstance().printStats();
+        }
+
+    private:
+        SockAddrIn _sa_in;
+        std::vector<std::unique_ptr<ReactorWorker>> _workers;
+        Fragmenter _fragmenter;
+
+        add_user_t _addUser;          // 添加用户函数
+        del_user_t _delUser;          // 删除用户函数
+        fetch_users_t _fetch_users;   // 获取当前用户列表函数
+        find_prefix_t _find_prefix;   // 查找发送者前缀函数
+        find_name_t _find_name;       // 按名字查找用户函数，为空时@开头的消息按普通消息广播
+        presence_query_t _presence_query; // 在线列表查询函数，为空时不回复查询
+        CookieJar _cookies;               // 上线握手的cookie，各事件循环共用
+        std::atomic<size_t> _send_batch{d_send_batch}; // 每次sendmmsg最多发送的消息数
+    };
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "sockaddr_in_t.hpp"
+#include "protocol.hpp"
+#include "capture.hpp"
+#include "cookie.hpp"
+#include "log.hpp"
+
+namespace UdpReplayModule
+{
+    using namespace SockAddrInModule;
+    using namespace ProtocolModule;
+    using namespace CaptureModule;
+    using namespace CookieModule;
+    using namespace LogSystemModule;
+
+    const int d_drain_ms = 1000;       // 发送结束后继续接收回包的时间
+    const size_t d_poll_every = 64;     // 全速回放时每发送多少个报文检查一次回包
+    const uint64_t d_pending_timeout_ms = 2000; // 超过该时间没有回显的消息记为未匹配
+    const uint64_t d_expire_every_ms = 100;     // 检查超时消息的间隔
+    const char d_prefix_end[] = "：";           // 服务器在发送者前缀末尾加的分隔符
+
+    struct ReplayOptions
+    {
+        std::string capture_path;
+        std::string server_ip;
+        uint16_t server_port = 0;
+        double speed = 1.0;        // 回放倍速，0表示全速
+        int drain_ms = d_drain_ms;
+        std::string csv_path;      // 追加写入结果，便于对比不同版本
+        std::string label;         // 结果中的版本标识
+    };
+
+    // 一次回放的延迟结果，对比多个服务器时并排输出
+    struct ReplaySummary
+    {
+        std::string label;
+        size_t samples = 0;
+        double p50 = 0;
+        double p90 = 0;
+        double p99 = 0;
+        double max = 0;
+        uint64_t unmatched = 0;
+    };
+
+    // 抓包中的每个来源地址对应一个本地套接字，服务器看到的发送者数量和原始流量一致
+    struct ReplayEndpoint
+    {
+        int sockfd;
+        std::unordered_map<std::string, std::deque<uint64_t>> pending; // 等待回显的消息内容 -> 发送时间，内容相同时按发送顺序匹配
+        std::string online;                                   // 最近发送的上线消息，收到cookie挑战时带上
+    };
+
+    class UdpReplay
+    {
+    private:
+        // 聊天消息"name:body"中的消息内容，上线、下线和控制帧不统计延迟
+        static bool chatBody(const std::string &data, std::string &body)
+        {
+            if (data.empty() || data[0] == frame_magic)
+                return false;
+            size_t colon = data.find(':');
+            if (colon == std::string::npos)
+                return false;
+            body = data.substr(colon + 1);
+            return !body.empty() && body != "online" && body != "quit";
+        }
+
+        int endpointFor(const struct sockaddr_in &from)
+        {
+            uint64_t key = addrKey(from);
+            auto it = _index.find(key);
+            if (it != _index.end())
+                return it->second;
+
+            int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            if (sockfd < 0)
+            {
+                LOG(LogLevel::WARNING) << "创建套接字失败：" << strerror(errno);
+                return -1;
+            }
+            int rcvbuf = 1 << 20;
+            setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = static_cast<uint32_t>(_endpoints.size());
+            epoll_ctl(_epfd, EPOLL_CTL_ADD, sockfd, &ev);
+
+            _endpoints.push_back(ReplayEndpoint{sockfd, {}, {}});
+            _index[key] = static_cast<int>(_endpoints.size() - 1);
+            return static_cast<int>(_endpoints.size() - 1);
+        }
+
+        // 接收回包，回包以已发送的消息内容结尾时记录延迟
+        void poll(int timeout_ms)
+        {
+            struct epoll_event events[64];
+            int n = epoll_wait(_epfd, events, 64, timeout_ms);
+            uint64_t now = monotonicNs();
+            for (int i = 0; i < n; i++)
+            {
+                ReplayEndpoint &ep = _endpoints[events[i].data.u32];
+                while (true)
+                {
+                    ssize_t ret = recv(ep.sockfd, _buffer.data(), _buffer.size(), 0);
+                    if (ret <= 0)
+                        break;
+                    _received++;
+
+                    // 抓包中的cookie已经过期，按当前服务器的挑战重新完成上线握手
+                    if (isFrame(_buffer.data(), ret, FrameType::Cookie))
+                    {
+                        std::string response = cookieResponse(_buffer.data(), ret, ep.online);
+                        if (!response.empty() && !ep.online.empty())
+                            sendto(ep.sockfd, response.data(), response.size(), 0, &_server, _server.getLength());
+                        continue;
+                    }
+
+                    // 回显为"前缀：内容"，名字或内容中也可能有分隔符，依次尝试每个分隔符之后的部分
+                    std::string_view data(_buffer.data(), ret);
+                    size_t sep = sizeof(d_prefix_end) - 1;
+                    for (size_t pos = data.find(d_prefix_end); pos != std::string_view::npos && !ep.pending.empty();
+                         pos = data.find(d_prefix_end, pos + sep))
+                    {
+                        auto it = ep.pending.find(std::string(data.substr(pos + sep)));
+                        if (it == ep.pending.end())
+                            continue;
+                        _latency_ns.push_back(now - it->second.front());
+                        it->second.pop_front();
+                        if (it->second.empty())
+                            ep.pending.erase(it);
+                        break;
+                    }
+                }
+            }
+
+            if (now - _expired_ns >= d_expire_every_ms * 1000000)
+            {
+                _expired_ns = now;
+                expire(now);
+            }
+        }
+
+        // 丢弃超时没有回显的消息，例如上线完成前发送的消息和私信，避免一直占用内存
+        void expire(uint64_t now)
+        {
+            uint64_t timeout = d_pending_timeout_ms * 1000000;
+            for (auto &ep : _endpoints)
+            {
+                for (auto it = ep.pending.begin(); it != ep.pending.end();)
+                {
+                    std::deque<uint64_t> &times = it->second;
+                    while (!times.empty() && now - times.front() >= timeout)
+                    {
+                        times.pop_front();
+                        _unmatched++;
+                    }
+                    it = times.empty() ? ep.pending.erase(it) : std::next(it);
+                }
+            }
+        }
+
+        static double percentileUs(std::vector<uint64_t> &samples, double p)
+        {
+            if (samples.empty())
+                return 0;
+            size_t i = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+            std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+            return samples[i] / 1000.0;
+        }
+
+    public:
+        UdpReplay(const ReplayOptions &options)
+            : _options(options), _server(options.server_port, options.server_ip), _epfd(-1), _buffer(65536),
+              _sent(0), _send_errors(0), _received(0), _unmatched(0), _expired_ns(0), _duration_ns(0)
+        {
+            _epfd = epoll_create1(0);
+        }
+
+        // 读取整个抓包文件，回放期间不再读文件
+        bool load()
+        {
+            CaptureReader reader;
+            if (!reader.open(_options.capture_path))
+            {
+                LOG(LogLevel::ERROR) << "打开抓包文件失败：" << _options.capture_path << " " << strerror(errno);
+                return false;
+            }
+
+            CaptureRecord r;
+            while (reader.next(r))
+                _records.push_back(r);
+            LOG(LogLevel::INFO) << "读取报文：" << _records.size();
+            return !_records.empty();
+        }
+
+        void run()
+        {
+            uint64_t base_ts = _records.front().ts_ns;
+            uint64_t start = monotonicNs();
+            std::string body;
+
+            for (size_t i = 0; i < _records.size(); i++)
+            {
+                const CaptureRecord &r = _records[i];
+
+                // 按原始间隔除以倍速等待，等待期间接收回包
+                if (_options.speed > 0)
+                {
+                    uint64_t due = start + static_cast<uint64_t>((r.ts_ns - base_ts) / _options.speed);
+                    uint64_t now = monotonicNs();
+                    while (now + 1000000 < due)
+                    {
+                        poll(static_cast<int>((due - now) / 1000000));
+                        now = monotonicNs();
+                    }
+                    while (monotonicNs() < due)
+                        ;
+                }
+                else if (i % d_poll_every == 0)
+                    poll(0);
+
+                // 抓包中客户端的cookie回复不再有效，由收到的挑战重新生成
+                if (isFrame(r.data.data(), r.data.size(), FrameType::Cookie))
+                    continue;
+
+                int idx = endpointFor(r.from);
+                if (idx < 0)
+                    continue;
+                ReplayEndpoint &ep = _endpoints[idx];
+                if (r.data.size() > 7 && r.data.compare(r.data.size() - 7, 7, ":online") == 0)
+                    ep.online = r.data;
+
+                uint64_t now = monotonicNs();
+                ssize_t ret = sendto(ep.sockfd, r.data.data(), r.data.size(), 0, &_server, _server.getLength());
+                if (ret < 0)
+                {
+                    _send_errors++;
+                    continue;
+                }
+                _sent++;
+                if (chatBody(r.data, body))
+                    ep.pending[body].push_back(now);
+            }
+            _duration_ns = monotonicNs() - start;
+
+            // 继续接收剩余的回包
+            uint64_t drain_end = monotonicNs() + static_cast<uint64_t>(_options.drain_ms) * 1000000;
+            while (monotonicNs() < drain_end)
+                poll(10);
+
+            for (auto &ep : _endpoints)
+                for (auto &p : ep.pending)
+                    _unmatched += p.second.size();
+        }
+
+        ReplaySummary summary()
+        {
+            ReplaySummary s;
+            s.label = _options.label;
+            s.samples = _latency_ns.size();
+            s.p50 = percentileUs(_latency_ns, 0.5);
+            s.p90 = percentileUs(_latency_ns, 0.9);
+            s.p99 = percentileUs(_latency_ns, 0.99);
+            s.max = _latency_ns.empty() ? 0 : *std::max_element(_latency_ns.begin(), _latency_ns.end()) / 1000.0;
+            s.unmatched = _unmatched;
+            return s;
+        }
+
+        void report()
+        {
+            double seconds = _duration_ns / 1e9;
+            double send_rate = seconds > 0 ? _sent / seconds : 0;
+            ReplaySummary s = summary();
+            double p50 = s.p50, p90 = s.p90, p99 = s.p99, max = s.max;
+
+            LOG(LogLevel::INFO) << "回放结果 发送者：" << _endpoints.size() << " 发送：" << _sent << " 发送失败：" << _send_errors
+                                << " 用时：" << seconds << "s 发送速率：" << send_rate << "/s 收到：" << _received;
+            LOG(LogLevel::INFO) << "回显延迟(us) 样本：" << _latency_ns.size() << " p50：" << p50 << " p90：" << p90
+                                << " p99：" << p99 << " max：" << max << " 未匹配：" << _unmatched;
+
+            if (_options.csv_path.empty())
+                return;
+
+            bool exists = std::ifstream(_options.csv_path).good();
+            std::ofstream out(_options.csv_path, std::ios::app);
+            if (!exists)
+                out << "label,capture,speed,senders,sent,send_errors,seconds,send_rate,received,samples,p50_us,p90_us,p99_us,max_us,unmatched\n";
+            out << _options.label << "," << _options.capture_path << "," << _options.speed << "," << _endpoints.size() << ","
+                << _sent << "," << _send_errors << "," << seconds << "," << send_rate << "," << _received << ","
+                << _latency_ns.size() << "," << p50 << "," << p90 << "," << p99 << "," << max << "," << _unmatched << "\n";
+        }
+
+        // 多个服务器的回放结果并排输出，例如默认模式和低延迟接收模式
+        static void compare(const std::vector<ReplaySummary> &results)
+        {
+            char line[256];
+            snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s %10s", "label", "samples", "p50_us", "p90_us", "p99_us", "max_us", "unmatched");
+            LOG(LogLevel::INFO) << "回显延迟对比\n" << line;
+            for (auto &r : results)
+            {
+                snprintf(line, sizeof(line), "%-16s %10zu %10.1f %10.1f %10.1f %10.1f %10lu", r.label.c_str(), r.samples,
+                         r.p50, r.p90, r.p99, r.max, static_cast<unsigned long>(r.unmatched));
+                LOG(LogLevel::INFO) << line;
+            }
+        }
+
+        ~UdpReplay()
+        {
+            for (auto &ep : _endpoints)
+                close(ep.sockfd);
+            if (_epfd >= 0)
+                close(_epfd);
+        }
+
+    private:
+        ReplayOptions _options;
+        SockAddrIn _server;
+        int _epfd;
+        std::vector<char> _buffer;
+
+        std::vector<CaptureRecord> _records;
+        std::vector<ReplayEndpoint> _endpoints;
+        std::unordered_map<uint64_t, int> _index; // 原始来源地址 -> 本地套接字
+
+        uint64_t _sent;
+        uint64_t _send_errors;
+        uint64_t _received;
+        uint64_t _unmatched;
+        uint64_t _expired_ns; // 上次检查超时消息的时间
+        uint64_t _duration_ns;
+        std::vector<uint64_t> _latency_ns;
+    };
+}
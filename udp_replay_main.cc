@@ -0,0 +1,90 @@
+#include "udp_replay.hpp"
+#include "log.hpp"
+#include <getopt.h>
+#include <sstream>
+
+using namespace UdpReplayModule;
+using namespace LogSystemModule;
+
+void usage(const char *proc)
+{
+    LOG(LogLevel::ERROR) << "错误使用，正确使用：" << proc << " [-x 倍速(0表示全速，默认1)] [-w 结束后等待回包毫秒数]"
+                         << " [-o 结果CSV文件] [-t 版本标识,版本标识...] 抓包文件 服务器IP 服务器端口[,服务器端口...]";
+    LOG(LogLevel::ERROR) << "指定多个端口时依次回放到每个服务器，最后并排输出延迟，版本标识与端口一一对应";
+}
+
+int main(int argc, char *argv[])
+{
+    ReplayOptions options;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "x:w:o:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'x':
+            options.speed = std::stod(optarg);
+            break;
+        case 'w':
+            options.drain_ms = std::stoi(optarg);
+            break;
+        case 'o':
+            options.csv_path = optarg;
+            break;
+        case 't':
+            options.label = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(4);
+        }
+    }
+
+    if (argc - optind != 3)
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+
+    options.capture_path = argv[optind];
+    options.server_ip = argv[optind + 1];
+
+    // 端口和版本标识都按逗号拆分，没有给出的版本标识使用端口号
+    auto split = [](const std::string &list)
+    {
+        std::vector<std::string> items;
+        std::stringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ','))
+            items.push_back(item);
+        return items;
+    };
+    std::vector<std::string> ports = split(argv[optind + 2]);
+    std::vector<std::string> labels = split(options.label);
+    if (ports.empty())
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+
+    std::vector<ReplaySummary> results;
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+        ReplayOptions target = options;
+        target.server_port = std::stoi(ports[i]);
+        target.label = i < labels.size() ? labels[i] : ports[i];
+
+        UdpReplay replay(target);
+        if (!replay.load())
+            exit(4);
+
+        replay.run();
+        replay.report();
+        results.push_back(replay.summary());
+    }
+
+    if (results.size() > 1)
+        UdpReplay::compare(results);
+
+    return 0;
+}
@@ -3,28 +3,92 @@
 #include <functional>
 #include <string>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 #include "sockaddr_in_t.hpp"
 #include "errors.hpp"
 #include "log.hpp"
 #include "user.hpp"
 #include "userInfo.hpp"
-#include "ThreadPool.hpp"
+#include "lanes.hpp"
+#include "strand.hpp"
+#include "protocol.hpp"
+#include "federation.hpp"
+#include "reliable.hpp"
+#include "fragment.hpp"
+#include "msg_pool.hpp"
+#include "capture.hpp"
+#include "trace.hpp"
+#include "presence.hpp"
+#include "cookie.hpp"
+#include "sanitize.hpp"
 
 using namespace UserManageModule;
 
 using add_user_t = std::function<void(const User &)>;
-using dispatch_msg_t = std::function<void(int, const std::string &)>;
+using dispatch_msg_t = std::function<void(int, const std::string &, std::string_view, size_t, size_t)>;
+using count_users_t = std::function<size_t()>;
+using prefix_ptr_t = std::shared_ptr<const std::string>;
+using find_prefix_t = std::function<prefix_ptr_t(const struct sockaddr_in &, const std::string &)>;
 using del_user_t = std::function<void(const User &)>;
-using task_t = std::function<void()>;
+using join_multicast_t = std::function<void(const struct sockaddr_in &)>;
+using direct_msg_t = std::function<bool(int, const std::string &, const std::string &, std::string_view)>;
+using presence_query_t = std::function<std::vector<std::string>(const struct sockaddr_in &, uint32_t, uint64_t)>;
 
 namespace UdpServerModule
 {
     // 默认端口和IP地址
     const uint16_t default_port = 8080;
+    // 单个分发任务负责的用户数，用户更多时拆成多个任务并行发送
+    const size_t d_chunk_users = 256;
+    // 私信在消息内容前附加的标记
+    const std::string d_direct_mark = "(私信) ";
+
+    // 低延迟接收模式的默认参数
+    const uint64_t d_busy_spin_us = 200;  // 没有报文时继续自旋的时间，超过后改为阻塞接收
+    const int d_busy_poll_us = 50;        // SO_BUSY_POLL：阻塞接收时在驱动队列上轮询的时间
+    const size_t d_inline_users = 64;     // 在线用户不超过该数量时在接收线程中直接分发
 
     using namespace LogSystemModule;
     using namespace SockAddrInModule;
-    using namespace ThreadPoolModule;
+    using namespace LaneModule;
+    using namespace StrandModule;
+    using namespace ProtocolModule;
+    using namespace FederationModule;
+    using namespace ReliableModule;
+    using namespace FragmentModule;
+    using namespace MessagePoolModule;
+    using namespace CaptureModule;
+    using namespace TraceModule;
+    using namespace PresenceModule;
+    using namespace CookieModule;
+    using namespace SanitizeModule;
+
+    // 设置套接字收发缓冲区，0表示不修改，记录内核实际使用的大小
+    inline void applySocketBuffers(int sockfd, int recv_buffer, int send_buffer)
+    {
+        if (recv_buffer > 0 && setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &recv_buffer, sizeof(recv_buffer)) < 0)
+            LOG(LogLevel::WARNING) << "设置接收缓冲区失败：" << strerror(errno);
+        if (send_buffer > 0 && setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer)) < 0)
+            LOG(LogLevel::WARNING) << "设置发送缓冲区失败：" << strerror(errno);
+
+        int rcv = 0, snd = 0;
+        socklen_t len = sizeof(rcv);
+        getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcv, &len);
+        len = sizeof(snd);
+        getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &snd, &len);
+        LOG(LogLevel::INFO) << "套接字" << sockfd << " 接收缓冲区：" << rcv << " 发送缓冲区：" << snd;
+    }
+
+    // 自旋等待时让出流水线，降低同一物理核上另一个超线程的开销
+    inline void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
 
     // 防止被拷贝的类
     class NoCopy
@@ -42,30 +106,377 @@ namespace UdpServerModule
 
     class UdpServer : public NoCopy
     {
+    private:
+        // 处理一个完整的数据报，控制帧在这里拆开，聊天消息交给handleMessage
+        void handleDatagram(const char *data, size_t len, const struct sockaddr_in &peer, bool reassembled = false)
+        {
+            // 分片重组完成后按完整数据报重新处理，不允许分片嵌套
+            if (isFrame(data, len, FrameType::Fragment))
+            {
+                std::string whole;
+                if (!reassembled && _reassembler.onFragment(data, len, peer, whole))
+                    handleDatagram(whole.data(), whole.size(), peer, true);
+                return;
+            }
+
+            // 对等节点转发过来的消息只投递给本节点的用户
+            if (_federation && isFrame(data, len, FrameType::Federation))
+            {
+                std::string message;
+                if (_federation->accept(data, len, peer, message))
+                {
+                    // 转发过来的消息已经带有发送者前缀
+                    static const prefix_ptr_t empty = std::make_shared<const std::string>();
+                    pushDispatch(empty, message, false, addrKey(peer), true);
+                }
+                return;
+            }
+
+            // 在线列表查询在控制通道中回复，与同一客户端的上线顺序一致
+            uint32_t epoch = 0;
+            uint64_t version = 0;
+            if (_presence_query && parsePresenceQuery(data, len, epoch, version))
+            {
+                presence_query_t query = _presence_query;
+                int sockfd = _socketfd;
+                struct sockaddr_in addr = peer;
+                _control_lane.push([query, sockfd, addr, epoch, version]()
+                                   {
+                    for (auto &frame : query(addr, epoch, version))
+                        sendto(sockfd, frame.data(), frame.size(), 0, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr)); });
+                return;
+            }
+
+            // 带cookie的上线回复，验证通过后按普通消息处理
+            if (isFrame(data, len, FrameType::Cookie))
+            {
+                const char *payload = nullptr;
+                size_t payload_len = 0;
+                if (!_cookies.verify(data, len, peer, payload, payload_len))
+                    return;
+
+                // 加入组播也必须带cookie，否则伪造源地址就能让其他用户收不到单播广播
+                // 与上线在同一个控制通道中处理，保证在上线之后，未上线的地址直接忽略
+                if (isFrame(payload, payload_len, FrameType::MulticastJoin))
+                {
+                    if (_join_multicast)
+                    {
+                        join_multicast_t join = _join_multicast;
+                        struct sockaddr_in addr = peer;
+                        _control_lane.push([join, addr]()
+                                           { join(addr); });
+                    }
+                    return;
+                }
+
+                // 可靠投递的请求同样需要cookie，否则伪造的请求会重置其他用户的序号和窗口
+                if (isFrame(payload, payload_len, FrameType::ReliableHello))
+                {
+                    if (_reliable)
+                        _reliable->addRecipient(peer);
+                    return;
+                }
+                handleMessage(payload, payload_len, peer, true);
+                return;
+            }
+
+            // 加入组播和可靠投递请求只接受cookie帧中的，直接发送的丢弃，不当作聊天消息
+            if (isFrame(data, len, FrameType::MulticastJoin) || isFrame(data, len, FrameType::ReliableHello))
+                return;
+
+            // 可靠投递的确认帧，请求帧放在cookie帧中
+            if (_reliable && isFrame(data, len, FrameType::ReliableAck))
+            {
+                _reliable->onAck(data, len, peer);
+                return;
+            }
+
+            handleMessage(data, len, peer);
+        }
+
+        // 处理"名字:内容"格式的聊天消息，verified表示源地址已经通过cookie验证
+        void handleMessage(const char *data, size_t len, const struct sockaddr_in &peer, bool verified = false)
+        {
+            // 校验UTF-8和控制字符的同时找出分隔符，有问题的消息改写后再处理
+            std::string sanitized;
+            ScanResult scan = scanPayload(data, len);
+            if (!scan.clean)
+            {
+                scan.colon = sanitize(data, len, sanitized);
+                data = sanitized.data();
+                len = sanitized.size();
+                _sanitized.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // 切割字符串，没有分隔符时名字和消息都是整条内容
+            const char *colon = scan.colon == no_colon ? nullptr : data + scan.colon;
+            std::string name(data, colon ? colon - data : len);
+            const char *body = colon ? colon + 1 : data;
+            std::string_view message(body, data + len - body);
+
+            if (message.size() == 0)
+                return;
+
+            // LOG(LogLevel::DEBUG) << "你好" << name << "信息：" << message;
+
+            // 上线和下线交给控制通道，接收线程不等待用户列表的锁
+            if (message == "quit" || message == "online")
+            {
+                bool online = message == "online";
+                // 未验证的上线只回复cookie挑战，不分配任何状态
+                if (online && !verified)
+                {
+                    std::string challenge = _cookies.challenge(peer);
+                    sendto(_socketfd, challenge.data(), challenge.size(), 0, reinterpret_cast<const struct sockaddr *>(&peer), sizeof(peer));
+                    return;
+                }
+                struct sockaddr_in addr = peer;
+                _control_lane.push([this, name, addr, online]()
+                                   { handleMembership(name, addr, online); });
+                return;
+            }
+
+            // 1. 获取发送者前缀，已上线用户直接使用上线时构建好的前缀
+            prefix_ptr_t prefix;
+            if (_find_prefix)
+                prefix = _find_prefix(peer, name);
+            // 未上线的用户临时构建前缀
+            if (!prefix)
+            {
+                SockAddrIn netUser(peer);
+                prefix = std::make_shared<const std::string>(User::formatPrefix(name, netUser.getIp(), netUser.getPort()));
+            }
+
+            // "@名字 内容"为私信，只发送给该名字的用户
+            if (_direct_message && message.size() > 1 && message[0] == '@')
+            {
+                size_t space = message.find(' ');
+                std::string target(message.substr(1, space == std::string_view::npos ? std::string_view::npos : space - 1));
+                std::string_view text = space == std::string_view::npos ? std::string_view() : message.substr(space + 1);
+                if (!target.empty() && !text.empty())
+                {
+                    pushDirect(prefix, target, text, peer);
+                    return;
+                }
+            }
+
+            Tracer::mark(TraceStage::Parse);
+
+            // 2. 消息只拷贝一次到池中的消息块，所有分发任务共用
+            pushDispatch(prefix, message, true, addrKey(peer), true);
+        }
+
+        // 在控制通道中执行成员变更，然后把上线/下线通知放入数据通道
+        void handleMembership(const std::string &name, const struct sockaddr_in &peer, bool online)
+        {
+            SockAddrIn netUser(peer);
+            User user(netUser.getPort(), netUser.getIp(), name);
+            prefix_ptr_t prefix;
+            std::string_view message;
+            if (online)
+            {
+                // 添加用户
+                _addUser(user);
+                prefix = user.getPrefix();
+                message = "online";
+            }
+            else
+            {
+                // 删除用户
+                _delUser(user);
+                if (_reliable)
+                    _reliable->removeRecipient(peer);
+                prefix = std::make_shared<const std::string>(user.getName() + " (" + netUser.getIp() + ":" + std::to_string(netUser.getPort()) + ")");
+                message = " offline";
+            }
+
+            pushDispatch(prefix, message, true, addrKey(peer));
+        }
+
+        // 创建私信任务，与发送者的第一段分发任务在同一个串行队列中，名字不存在时回复发送者
+        void pushDirect(const prefix_ptr_t &prefix, const std::string &target, std::string_view message, const struct sockaddr_in &peer)
+        {
+            direct_msg_t direct = _direct_message;
+            int sockfd = _socketfd;
+            struct sockaddr_in addr = peer;
+            auto send = [direct, sockfd, addr](const std::string &prefix, const std::string &target, std::string_view message)
+            {
+                std::string text = d_direct_mark;
+                text.append(message.data(), message.size());
+                if (direct(sockfd, target, prefix, text))
+                    return;
+
+                std::string reply = "系统：用户" + target + "不在线";
+                sendto(sockfd, reply.data(), reply.size(), 0, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr));
+            };
+
+            // 直接发送也占用一个排队名额，排队上限同样适用
+            if (!admit(1))
+                return;
+
+            // 低延迟模式下私信直接发送，消息不需要拷贝；只在接收线程中调用
+            if (_busy_poll && _strands.tryRun(addrKey(peer) * d_chunk_users, [&]()
+                                              { send(*prefix, target, message); }))
+            {
+                _queued.fetch_sub(1, std::memory_order_relaxed);
+                _inline_msgs++;
+                return;
+            }
+
+            MessageRef ref(message.data(), message.size());
+            std::atomic<size_t> *queued = &_queued;
+            _strands.post(addrKey(peer) * d_chunk_users, [send, prefix, target, ref, queued]()
+                          {
+                queued->fetch_sub(1, std::memory_order_relaxed);
+                send(*prefix, target, ref.view()); });
+        }
+
+        // 创建分发任务，用户较多时按段拆分成多个任务，第一个任务同时转发给其他节点
+        // 同一个发送者的同一段任务在同一个串行队列中执行，接收者看到的消息顺序与发送顺序一致
+        // may_inline只由接收线程传入true，控制通道中的上线/下线通知总是放入数据通道
+        void pushDispatch(const prefix_ptr_t &prefix, std::string_view message, bool forward, uint64_t sender, bool may_inline = false)
+        {
+            size_t users = _count_users ? _count_users() : 0;
+            size_t chunks = std::max<size_t>(1, (users + d_chunk_users - 1) / d_chunk_users);
+
+            // 被采样的消息把已经经过的阶段带到每个分发任务中
+            std::shared_ptr<const TraceSpan> trace;
+            if (TraceSpan *span = Tracer::getCurrent())
+            {
+                span->mark(TraceStage::Enqueue);
+                trace = std::make_shared<const TraceSpan>(*span);
+            }
+
+            std::shared_ptr<Federation> federation = forward ? _federation : nullptr;
+            dispatch_msg_t dispatch = _dispatch_message;
+            int sockfd = _socketfd;
+
+            // 直接分发也先登记，排队上限同样适用
+            if (!admit(chunks))
+                return;
+
+            // 低延迟模式下小房间直接在接收线程分发，不经过线程池，消息也不需要拷贝
+            // 发送者的串行队列中还有任务时仍然排队，保证顺序
+            if (may_inline && _busy_poll && chunks == 1 && users <= _inline_users &&
+                _strands.tryRun(sender * d_chunk_users, [&]()
+                                {
+                    Tracer::getInstance().run(trace, 0, [&]()
+                                              { dispatch(sockfd, *prefix, message, 0, 1); });
+                    if (federation)
+                        federation->forward(sockfd, *prefix, message); }))
+            {
+                _queued.fetch_sub(1, std::memory_order_relaxed);
+                _inline_msgs++;
+                return;
+            }
+
+            MessageRef ref(message.data(), message.size());
+            std::atomic<size_t> *queued = &_queued;
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                _strands.post(sender * d_chunk_users + chunk, [federation, dispatch, sockfd, prefix, ref, chunk, chunks, trace, queued]()
+                              {
+                    queued->fetch_sub(1, std::memory_order_relaxed);
+                    Tracer::getInstance().run(trace, chunk, [&]()
+                                              { dispatch(sockfd, *prefix, ref.view(), chunk, chunks); });
+                    if (federation && chunk == 0)
+                        federation->forward(sockfd, *prefix, ref.view()); });
+            }
+        }
+
+        // 等待执行的分发任务达到上限时丢弃新消息，否则登记tasks个任务
+        bool admit(size_t tasks)
+        {
+            size_t limit = _queue_limit.load(std::memory_order_relaxed);
+            if (limit > 0 && _queued.load(std::memory_order_relaxed) >= limit)
+            {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _queued.fetch_add(tasks, std::memory_order_relaxed);
+            return true;
+        }
+
+        // 低延迟模式：接收线程绑定到指定的核，开启SO_BUSY_POLL
+        void prepareBusyPoll()
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(_busy_cpu, &set);
+            int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (ret != 0)
+                LOG(LogLevel::WARNING) << "接收线程绑定CPU" << _busy_cpu << "失败：" << strerror(ret);
+
+            // 超过net.core.busy_read的值需要CAP_NET_ADMIN，失败时只靠用户态自旋
+            int busy_poll = d_busy_poll_us;
+            if (setsockopt(_socketfd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) < 0)
+                LOG(LogLevel::WARNING) << "设置SO_BUSY_POLL失败：" << strerror(errno);
+
+            LOG(LogLevel::INFO) << "低延迟接收模式 CPU：" << _busy_cpu << " 自旋预算(us)：" << _spin_ns / 1000
+                                << " 直接分发用户数上限：" << _inline_users;
+        }
+
+        // 接收一个报文，开启追踪时同时取得内核收到报文的时间和recvmsg返回的时间
+        ssize_t receive(char *buffer, struct sockaddr_in &peer, uint64_t &arrive_ns, uint64_t &recv_ns, int flags = 0)
+        {
+            if (!_trace)
+            {
+                socklen_t length = sizeof(peer);
+                return recvfrom(_socketfd, buffer, d_max_datagram, flags, reinterpret_cast<struct sockaddr *>(&peer), &length);
+            }
+
+            struct iovec iov;
+            iov.iov_base = buffer;
+            iov.iov_len = d_max_datagram;
+            char control[CMSG_SPACE(sizeof(struct timespec))];
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &peer;
+            hdr.msg_namelen = sizeof(peer);
+            hdr.msg_iov = &iov;
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = control;
+            hdr.msg_controllen = sizeof(control);
+
+            ssize_t ret = recvmsg(_socketfd, &hdr, flags);
+            recv_ns = traceNowNs();
+            arrive_ns = 0;
+            for (struct cmsghdr *c = CMSG_FIRSTHDR(&hdr); ret > 0 && c; c = CMSG_NXTHDR(&hdr, c))
+            {
+                if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPNS)
+                    continue;
+
+                // 内核时间戳为CLOCK_REALTIME，按与当前时间的差换算到CLOCK_MONOTONIC
+                struct timespec kernel, now;
+                memcpy(&kernel, CMSG_DATA(c), sizeof(kernel));
+                clock_gettime(CLOCK_REALTIME, &now);
+                int64_t delay = (now.tv_sec - kernel.tv_sec) * 1000000000LL + (now.tv_nsec - kernel.tv_nsec);
+                arrive_ns = recv_ns - std::min<uint64_t>(recv_ns, std::max<int64_t>(0, delay));
+            }
+            return ret;
+        }
+
     public:
-        UdpServer(add_user_t addUser, dispatch_msg_t dispatchMsg, del_user_t delUser, uint16_t port = default_port)
-            : _socketfd(-1), _sa_in(port), _isRunning(false), _addUser(addUser), _dispatch_message(dispatchMsg), _delUser(delUser)
+        UdpServer(add_user_t addUser, dispatch_msg_t dispatchMsg, del_user_t delUser, uint16_t port = default_port, size_t max_message = d_max_message)
+            : _socketfd(-1), _sa_in(port), _isRunning(false), _control_lane("控制", d_control_threads), _data_lane("数据", d_data_threads), _strands(_data_lane),
+              _addUser(addUser), _dispatch_message(dispatchMsg), _delUser(delUser), _reassembler(max_message + d_max_overhead)
         {
             // 创建服务器套接字
             _socketfd = socket(AF_INET, SOCK_DGRAM, 0);
 
-            _tp = ThreadPool<task_t>::getInstance();
-
-            if (!_tp)
+            if (!_control_lane.start() || !_data_lane.start())
             {
                 LOG(LogLevel::ERROR) << "线程池启动失败";
                 return;
             }
 
-            _tp->startThreads();
-
             if (_socketfd < 0)
             {
                 LOG(LogLevel::FATAL) << "Server initiate error：" << strerror(errno);
                 exit(static_cast<int>(ErrorNumber::SocketFail));
             }
 
-            LOG(LogLevel::INFO) << "Server initiated：" << _socketfd;
+            LOG(LogLevel::INFO) << "Server initiated：" << _socketfd << " 消息校验：" << scanKernel().name;
 
             int ret = bind(_socketfd, &_sa_in, _sa_in.getLength());
 
@@ -84,80 +495,240 @@ namespace UdpServerModule
             if (!_isRunning)
             {
                 _isRunning = true;
-                while (true)
+
+                // 开启追踪时由内核记录报文到达时间
+                Tracer &tracer = Tracer::getInstance();
+                _trace = tracer.isEnabled();
+                if (_trace)
                 {
-                    // 1. 接收客户端信息
-                    char buffer[1024] = {0};
-                    struct sockaddr_in peer;
-                    socklen_t length = sizeof(peer);
-                    ssize_t ret = recvfrom(_socketfd, buffer, sizeof(buffer) - 1, 0, reinterpret_cast<struct sockaddr *>(&peer), &length);
+                    int on = 1;
+                    setsockopt(_socketfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+                }
 
-                    if (ret > 0)
-                    {
-                        // 1. 根据收到的消息构建User对象
-                        SockAddrIn netUser(peer);
-                        // 切割字符串
-                        std::string fullInfo = buffer;
-                        // 获取名字
-                        auto pos = fullInfo.find(":", 0);
-                        std::string name = fullInfo.substr(0, pos);
-                        // 获取消息
-                        std::string message = fullInfo.substr(pos + 1, fullInfo.size());
+                if (_busy_poll)
+                    prepareBusyPoll();
 
-                        if (message.size() == 0)
-                            continue;
+                // 低延迟模式下先非阻塞地自旋接收，连续空转超过自旋预算后阻塞等待下一个报文
+                bool spinning = _busy_poll;
+                uint64_t idle_since = 0;
 
-                        // LOG(LogLevel::DEBUG) << "你好" << name << "信息：" << message;
+                // 接收缓冲区不小于UDP最大报文，避免截断
+                std::unique_ptr<char[]> buffer = std::make_unique<char[]>(d_max_datagram);
+                while (_isRunning)
+                {
+                    // 1. 接收客户端信息
+                    struct sockaddr_in peer;
+                    uint64_t arrive_ns = 0;
+                    uint64_t recv_ns = 0;
+                    ssize_t ret = receive(buffer.get(), peer, arrive_ns, recv_ns, spinning ? MSG_DONTWAIT : 0);
 
-                        User user(netUser.getPort(), netUser.getIp(), name);
+                    // 被信号打断时重新检查运行状态
+                    if (ret < 0 && errno == EINTR)
+                        continue;
 
-                        // 1.1 判断是删除还是添加
-                        if (strcmp(message.c_str(), "quit") == 0)
+                    if (spinning && ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    {
+                        uint64_t now = traceNowNs();
+                        if (idle_since == 0)
+                            idle_since = now;
+                        else if (now - idle_since > _spin_ns)
                         {
-                            // 删除用户
-                            _delUser(user);
-                            message = user.getName() + " (" + user.getSockAddrIn().getIp() + ":" + std::to_string(user.getSockAddrIn().getPort()) + ")" + " offline";
+                            spinning = false;
+                            _blocking_waits++;
                         }
-                        else if (strcmp(message.c_str(), "online") == 0)
+                        cpuRelax();
+                        continue;
+                    }
+                    if (_busy_poll && ret >= 0)
+                    {
+                        (spinning ? _spin_hits : _wakeups)++;
+                        spinning = true;
+                        idle_since = 0;
+                    }
+
+                    if (ret > 0)
+                    {
+                        if (_capture)
+                            _capture->record(buffer.get(), ret, peer);
+
+                        if (_trace && tracer.sample())
                         {
-                            // 添加用户
-                            _addUser(user);
-                            message = user.getName() + " (" + user.getSockAddrIn().getIp() + ":" + std::to_string(user.getSockAddrIn().getPort()) + ")：" + message;
+                            TraceSpan span;
+                            tracer.begin(span);
+                            span.ts[static_cast<int>(TraceStage::Arrive)] = arrive_ns;
+                            span.ts[static_cast<int>(TraceStage::Recv)] = recv_ns;
+                            tracer.setCurrent(&span);
+                            handleDatagram(buffer.get(), ret, peer);
+                            tracer.setCurrent(nullptr);
                         }
                         else
-                        {
-                            // 仅添加用户标识
-                            message = user.getName() + " (" + user.getSockAddrIn().getIp() + ":" + std::to_string(user.getSockAddrIn().getPort()) + ")：" + message;
-                        }
-
-                        // 2. 创建线程池并添加任务
-                        task_t task = std::bind(UdpServer::_dispatch_message, _socketfd, message);
-                        _tp->pushTasks(task);
+                            handleDatagram(buffer.get(), ret, peer);
                     }
                 }
             }
         }
 
-        // 停止服务器
+        // 设置获取在线用户数的方式，用于拆分分发任务，需要在start之前调用
+        void setUserCount(count_users_t count_users)
+        {
+            _count_users = count_users;
+        }
+
+        // 启用组播投递：设置发送组播的出口、TTL和本机回环，收到客户端的加入帧后调用join
+        bool setMulticast(const std::string &iface, join_multicast_t join)
+        {
+            struct in_addr ifaddr;
+            ifaddr.s_addr = iface.empty() ? htonl(INADDR_ANY) : inet_addr(iface.c_str());
+            unsigned char ttl = 1;
+            unsigned char loop = 1;
+            if (setsockopt(_socketfd, IPPROTO_IP, IP_MULTICAST_IF, &ifaddr, sizeof(ifaddr)) < 0 ||
+                setsockopt(_socketfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+                setsockopt(_socketfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+            {
+                LOG(LogLevel::ERROR) << "设置组播选项失败：" << strerror(errno);
+                return false;
+            }
+
+            _join_multicast = join;
+            return true;
+        }
+
+        // 启用"@名字 内容"格式的私信，需要在start之前调用
+        void setDirectMessage(direct_msg_t direct_message)
+        {
+            _direct_message = direct_message;
+        }
+
+        // 启用在线列表查询，需要在start之前调用
+        void setPresence(presence_query_t presence_query)
+        {
+            _presence_query = presence_query;
+        }
+
+        // 设置发送者前缀的查找方式，需要在start之前调用
+        void setPrefixLookup(find_prefix_t find_prefix)
+        {
+            _find_prefix = find_prefix;
+        }
+
+        // 启用多节点转发，需要在start之前调用
+        void setFederation(std::shared_ptr<Federation> federation)
+        {
+            _federation = federation;
+        }
+
+        // 启用可靠投递，需要在start之前调用
+        void setReliable(std::shared_ptr<ReliableSender> reliable)
+        {
+            _reliable = reliable;
+            _reliable->start(_socketfd);
+        }
+
+        // 数据通道排队延迟超过目标时扩容，空闲时回收到初始线程数
+        void setAdaptive(size_t max_threads, uint64_t target_us = d_adapt_target_us)
+        {
+            _data_lane.enableAdaptive(max_threads, target_us);
+        }
+
+        // 开启低延迟接收模式，cpu为接收线程绑定的核，需要在start之前调用
+        // 接收线程自旋接收，空闲超过spin_us后阻塞；在线用户不超过inline_users时在接收线程中直接分发
+        void setBusyPoll(int cpu, uint64_t spin_us = d_busy_spin_us, size_t inline_users = d_inline_users)
+        {
+            _busy_poll = true;
+            _busy_cpu = cpu;
+            _spin_ns = spin_us * 1000;
+            _inline_users = std::min(inline_users, d_chunk_users);
+        }
+
+        // 以下设置可以在运行时调用
+        // 调整数据通道线程数
+        void setDataThreads(size_t threads)
+        {
+            _data_lane.setThreads(threads);
+        }
+
+        // 等待执行的分发任务上限，0表示不限制
+        void setQueueLimit(size_t limit)
+        {
+            _queue_limit.store(limit, std::memory_order_relaxed);
+        }
+
+        // 设置套接字收发缓冲区，0表示不修改
+        void setSocketBuffers(int recv_buffer, int send_buffer)
+        {
+            applySocketBuffers(_socketfd, recv_buffer, send_buffer);
+        }
+
+        // 记录收到的所有报文，用于回放，需要在start之前调用
+        void setCapture(std::shared_ptr<CaptureWriter> capture)
+        {
+            _capture = capture;
+        }
+
+        // 停止服务器，start在当前消息处理完后返回，可以在信号处理函数中调用
         void stop()
         {
-            if (_isRunning)
-                close(_socketfd);
+            _isRunning = false;
         }
 
         ~UdpServer()
         {
-            stop();
+            // 先结束控制通道，它产生的通知进入数据通道后再结束数据通道，确保剩余的任务执行完毕
+            _control_lane.stop();
+            _data_lane.stop();
+
+            if (_reliable)
+                _reliable->stop();
+
+            _reassembler.printStats();
+            MessagePool::getInstance().printStats();
+            if (_dropped > 0)
+                LOG(LogLevel::WARNING) << "分发队列已满丢弃消息：" << _dropped;
+            if (_sanitized > 0)
+                LOG(LogLevel::INFO) << "改写的消息(无效UTF-8或控制字符)：" << _sanitized;
+            if (_busy_poll)
+                LOG(LogLevel::INFO) << "低延迟接收 自旋收到：" << _spin_hits << " 阻塞后收到：" << _wakeups
+                                    << " 转为阻塞：" << _blocking_waits << " 直接分发：" << _inline_msgs;
+
+            if (_socketfd >= 0)
+                close(_socketfd);
         }
 
     private:
         int _socketfd; // 套接字文件描述符
         SockAddrIn _sa_in;
-        bool _isRunning; // 服务器是否正在运行
-        std::shared_ptr<ThreadPool<task_t>> _tp;
+        volatile bool _isRunning; // 服务器是否正在运行
+        bool _trace = false;      // 是否开启采样追踪，只在接收线程中使用
+        TaskLane<control_lane> _control_lane; // 成员变更通道，不会排在大量分发任务后面
+        TaskLane<data_lane> _data_lane;       // 聊天消息分发通道
+        StrandExecutor<TaskLane<data_lane>> _strands; // 按发送者串行的分发队列
 
         add_user_t _addUser;              // 添加用户函数
         dispatch_msg_t _dispatch_message; // 分发消息函数
         del_user_t _delUser;              // 删除用户函数
+        find_prefix_t _find_prefix;       // 查找发送者前缀函数
+        count_users_t _count_users;       // 获取在线用户数函数
+        direct_msg_t _direct_message;     // 私信函数，为空时@开头的消息按普通消息广播
+        join_multicast_t _join_multicast; // 客户端加入组播函数，为空时不使用组播
+        presence_query_t _presence_query; // 在线列表查询函数，为空时不回复查询
+        CookieJar _cookies;               // 上线握手的cookie
+        std::atomic<size_t> _queue_limit{0}; // 等待执行的分发任务上限
+        std::atomic<size_t> _queued{0};      // 等待执行的分发任务数
+        std::atomic<uint64_t> _dropped{0};   // 队列已满时丢弃的消息数
+        std::atomic<uint64_t> _sanitized{0}; // 改写过的消息数
+
+        bool _busy_poll = false;        // 是否开启低延迟接收模式
+        int _busy_cpu = 0;              // 接收线程绑定的核
+        uint64_t _spin_ns = 0;          // 自旋预算
+        size_t _inline_users = 0;       // 直接分发的在线用户数上限
+        uint64_t _spin_hits = 0;        // 自旋期间收到的报文数，只在接收线程中修改
+        uint64_t _wakeups = 0;          // 阻塞等待后收到的报文数
+        uint64_t _blocking_waits = 0;   // 自旋超时转为阻塞的次数
+        uint64_t _inline_msgs = 0;      // 直接分发的消息数
+
+        std::shared_ptr<Federation> _federation; // 多节点转发，为空时只在本节点内分发
+        std::shared_ptr<ReliableSender> _reliable; // 可靠投递，为空时不处理请求和确认帧
+        Reassembler _reassembler;                  // 分片重组，只在接收线程中使用
+        std::shared_ptr<CaptureWriter> _capture;   // 抓包，为空时不记录
     };
 } // namespace UdpServerModule
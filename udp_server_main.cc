@@ -1,44 +1,380 @@
 #include "udp_server.hpp"
+#include "udp_reactor.hpp"
 #include "user.hpp"
+#include "user_snapshot.hpp"
+#include "federation.hpp"
+#include "reliable.hpp"
+#include "trace.hpp"
 #include "log.hpp"
+#include "config.hpp"
 #include <memory>
+#include <signal.h>
+#include <getopt.h>
 
 using namespace UdpServerModule;
+using namespace UdpReactorModule;
 using namespace UserManageModule;
+using namespace UserSnapshotModule;
+using namespace FederationModule;
+using namespace ReliableModule;
+using namespace TraceModule;
 using namespace LogSystemModule;
+using namespace ConfigModule;
+
+std::shared_ptr<UdpServer> udp_server;
+std::shared_ptr<UdpReactorServer> reactor_server;
+
+void quit(int sig)
+{
+    (void)sig;
+    // 仅修改运行状态，快照在主线程中保存
+    if (udp_server)
+        udp_server->stop();
+    if (reactor_server)
+        reactor_server->stop();
+}
+
+// 日志等级和文本日志输出位置，两种引擎共用
+void applyLogConfig(const ServerConfig &old, const ServerConfig &next)
+{
+    if (next.log_level != old.log_level)
+        loghandler.setLevel(next.log_level);
+    if (next.log_sink != old.log_sink)
+    {
+        if (next.log_sink == "console")
+            loghandler.enableConsoleLog();
+        else if (next.log_sink == "file")
+            loghandler.enableFileLog();
+        else
+            LOG(LogLevel::WARNING) << "二进制日志只能在启动时使用-b开启，文本日志保持原输出";
+    }
+}
+
+// 指定了配置文件时加载一次，出错时退出，之后收到SIGHUP时重新加载
+std::unique_ptr<ConfigReloader> startReloader(const std::string &config_path, const ServerConfig &base, ConfigReloader::apply_t apply)
+{
+    if (config_path.empty())
+        return nullptr;
+
+    std::unique_ptr<ConfigReloader> reloader = std::make_unique<ConfigReloader>(config_path, base, max_send_batch, apply);
+    if (!reloader->reload())
+        exit(4);
+    reloader->start();
+    return reloader;
+}
+
+// 协程引擎：在事件循环中完成接收、成员变更和分发，不使用线程池
+void runReactor(UserManager &usm, SnapshotSaver &saver, uint16_t port, size_t max_message, size_t loops,
+                const std::string &config_path, const ServerConfig &base)
+{
+    reactor_server = std::make_shared<UdpReactorServer>([&usm](const User &user)
+                                                        { usm.addUser(user); },
+                                                        [&usm](const User &user)
+                                                        { usm.delUser(user); },
+                                                        [&usm]()
+                                                        { return usm.getUserList(); }, port, max_message, loops);
+    reactor_server->setPrefixLookup([&usm](const struct sockaddr_in &addr, const std::string &name)
+                                    { return usm.findPrefix(addr, name); });
+    reactor_server->setDirectMessage([&usm](const std::string &name)
+                                     { return usm.findByName(name); });
+    reactor_server->setPresence([&usm](const struct sockaddr_in &from, uint32_t epoch, uint64_t version)
+                                { return usm.presenceUpdates(from, epoch, version); });
+
+    // 协程引擎没有线程池和分发队列，data_threads和queue_limit不起作用
+    std::unique_ptr<ConfigReloader> reloader = startReloader(config_path, base, [](const ServerConfig &old, const ServerConfig &next)
+                                                             {
+        applyLogConfig(old, next);
+        if (next.recv_buffer != old.recv_buffer || next.send_buffer != old.send_buffer)
+            reactor_server->setSocketBuffers(next.recv_buffer, next.send_buffer);
+        if (next.send_batch != old.send_batch)
+            reactor_server->setSendBatch(next.send_batch); });
+
+    saver.start();
+
+    reactor_server->start();
+
+    if (reloader)
+        reloader->stop();
+    reactor_server.reset();
+}
+
+void usage(const char *proc)
+{
+    LOG(LogLevel::ERROR) << "错误使用，正确使用：" << proc << " [-s 快照文件] [-i 快照间隔秒数(0表示仅退出时保存)]"
+                         << " [-n 节点ID] [-p 对等节点ip:port,ip:port] [-r(开启可靠投递)]"
+                         << " [-m 最大消息字节数] [-b(二进制日志，使用logdecode查看)] [-f(文本日志写入文件)] [-c 抓包文件]"
+                         << " [-g 组播组ip:port] [-G 组播出口地址] [-a 数据通道最大线程数] [-l p99排队延迟目标us]"
+                         << " [-e threads|reactor(处理引擎)] [-t 事件循环数]"
+                         << " [-T 追踪采样间隔(每N条消息追踪一条)] [-o 追踪导出文件前缀]"
+                         << " [-C 配置文件(收到SIGHUP时重新加载)] [-B 低延迟接收绑定的CPU] [-W 自旋预算us]"
+                         << " [端口]";
+}
 
 int main(int argc, char *argv[])
 {
+    std::string snapshot_path = d_snapshot_path;
+    int snapshot_interval = d_snapshot_interval;
+    uint32_t node_id = 0;
+    std::string peers;
+    bool reliable = false;
+    size_t max_message = d_max_message;
+    std::string capture_path;
+    std::string group;
+    std::string group_iface;
+    size_t adaptive_threads = 0;
+    uint64_t adaptive_target_us = d_adapt_target_us;
+    std::string engine = "threads";
+    size_t loops = d_reactor_loops;
+    uint32_t trace_rate = 0;
+    std::string trace_path = d_trace_path;
+    std::string config_path;
+    bool file_log = false;
+    bool binary_log = false;
+    int busy_cpu = -1;
+    uint64_t spin_us = d_busy_spin_us;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "s:i:n:p:rm:bfc:g:G:a:l:e:t:T:o:C:B:W:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            snapshot_path = optarg;
+            break;
+        case 'i':
+            snapshot_interval = std::stoi(optarg);
+            break;
+        case 'n':
+            node_id = std::stoul(optarg);
+            break;
+        case 'p':
+            // 可以多次指定
+            peers += std::string(optarg) + ",";
+            break;
+        case 'r':
+            reliable = true;
+            break;
+        case 'm':
+            max_message = std::stoul(optarg);
+            break;
+        case 'g':
+            group = optarg;
+            break;
+        case 'G':
+            group_iface = optarg;
+            break;
+        case 'a':
+            adaptive_threads = std::stoul(optarg);
+            break;
+        case 'l':
+            adaptive_target_us = std::stoull(optarg);
+            break;
+        case 'e':
+            engine = optarg;
+            break;
+        case 't':
+            loops = std::stoul(optarg);
+            break;
+        case 'T':
+            trace_rate = std::stoul(optarg);
+            break;
+        case 'o':
+            trace_path = optarg;
+            break;
+        case 'c':
+            capture_path = optarg;
+            break;
+        case 'C':
+            config_path = optarg;
+            break;
+        case 'B':
+            busy_cpu = std::stoi(optarg);
+            break;
+        case 'W':
+            spin_us = std::stoull(optarg);
+            break;
+        case 'f':
+            file_log = true;
+            break;
+        case 'b':
+            binary_log = true;
+            break;
+        default:
+            usage(argv[0]);
+            exit(4);
+        }
+    }
+
+    uint16_t port = default_port;
+    if (argc - optind == 1)
+        port = std::stoi(argv[optind]);
+    else if (argc - optind > 1)
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+
+    // SIGHUP由重新加载线程同步等待，必须在创建任何线程之前屏蔽，日志输出也可能创建线程
+    if (!config_path.empty())
+        ConfigReloader::blockSignal();
+
+    if (file_log)
+        ENABLEFILELOG();
+    if (binary_log && !loghandler.enableBinaryLog())
+    {
+        LOG(LogLevel::FATAL) << "二进制日志文件打开失败：" << strerror(errno);
+        exit(static_cast<int>(ErrorNumber::OpenLogFail));
+    }
+
+    // 配置文件中没有出现的项使用启动参数决定的值
+    ServerConfig base;
+    base.data_threads = d_data_threads;
+    base.log_sink = file_log ? "file" : "console";
+    base.send_batch = d_send_batch;
+
+    if (engine != "threads" && engine != "reactor")
+    {
+        usage(argv[0]);
+        exit(4);
+    }
+    if (engine == "reactor" && (!peers.empty() || reliable || !group.empty() || !capture_path.empty() || adaptive_threads > 0 || trace_rate > 0 || busy_cpu >= 0))
+    {
+        LOG(LogLevel::FATAL) << "协程引擎不支持多节点转发、可靠投递、组播、抓包、自适应线程池、追踪和低延迟接收";
+        exit(4);
+    }
+
     // 创建UserManager对象
     std::shared_ptr<UserManager> usm = std::make_shared<UserManager>();
+
+    // 在开始接收消息之前从快照恢复在线用户
+    SnapshotSaver saver(*usm, snapshot_path, snapshot_interval);
+    saver.restore();
+
+    // 捕捉2号和15号信号，不设置SA_RESTART使recvfrom被打断
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = quit;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+
+    if (engine == "reactor")
+    {
+        runReactor(*usm, saver, port, max_message, loops, config_path, base);
+        saver.stop();
+        LOG(LogLevel::INFO) << "成员变更 上线：" << usm->getJoins() << " 下线：" << usm->getLeaves();
+        LOG(LogLevel::INFO) << "服务器退出";
+        return 0;
+    }
+
     // 创建UdpServerModule对象
-    std::shared_ptr<UdpServer> udp_server;
-    if (argc == 1)
+    udp_server = std::make_shared<UdpServer>([&usm](const User &user)
+                                             { usm->addUser(user); },
+                                             [&usm](int sockfd, const std::string &prefix, std::string_view message, size_t chunk, size_t chunks)
+                                             { usm->dispatchMessage(sockfd, prefix, message, chunk, chunks); },
+                                             [&usm](const User &user)
+                                             { usm->delUser(user); }, port, max_message);
+    udp_server->setPrefixLookup([&usm](const struct sockaddr_in &addr, const std::string &name)
+                                { return usm->findPrefix(addr, name); });
+    udp_server->setUserCount([&usm]()
+                             { return usm->getUserCount(); });
+    udp_server->setDirectMessage([&usm](int sockfd, const std::string &name, const std::string &prefix, std::string_view message)
+                                 { return usm->sendDirect(sockfd, name, prefix, message); });
+    udp_server->setPresence([&usm](const struct sockaddr_in &from, uint32_t epoch, uint64_t version)
+                            { return usm->presenceUpdates(from, epoch, version); });
+
+    // 配置了对等节点时启用多节点转发，节点ID默认使用端口号
+    if (!peers.empty())
     {
-        udp_server = std::make_shared<UdpServer>([&usm](const User &user)
-                                                 { usm->addUser(user); },
-                                                 [&usm](int sockfd, const std::string &message)
-                                                 { usm->dispatchMessage(sockfd, message); },
-                                                 [&usm](const User &user)
-                                                 { usm->delUser(user); });
+        if (node_id == 0)
+            node_id = port;
+        udp_server->setFederation(std::make_shared<Federation>(node_id, Federation::parsePeers(peers)));
     }
-    else if (argc == 2)
+
+    // 开启可靠投递后，请求过可靠投递的客户端收到带序号的消息
+    if (reliable)
     {
-        uint16_t port = std::stoi(argv[1]);
-        udp_server = std::make_shared<UdpServer>([&usm](const User &user)
-                                                 { usm->addUser(user); },
-                                                 [&usm](int sockfd, const std::string &message)
-                                                 { usm->dispatchMessage(sockfd, message); },
-                                                 [&usm](const User &user)
-                                                 { usm->delUser(user); }, port);
+        std::shared_ptr<ReliableSender> sender = std::make_shared<ReliableSender>();
+        udp_server->setReliable(sender);
+        usm->setSendHook([sender](int, const struct sockaddr_in &addr, const std::string &prefix, std::string_view message)
+                         { return sender->send(addr, prefix, message); });
     }
-    else
+
+    // 开启组播投递后，加入组播组的客户端只从组播组接收广播，其余客户端仍然单播
+    if (!group.empty())
     {
-        LOG(LogLevel::ERROR) << "错误使用，正确使用：" << argv[0] << " 端口（或者不写）";
-        exit(4);
+        size_t colon = group.rfind(':');
+        if (colon == std::string::npos)
+        {
+            LOG(LogLevel::FATAL) << "无效的组播组：" << group;
+            exit(4);
+        }
+        SockAddrIn group_addr(static_cast<uint16_t>(std::stoi(group.substr(colon + 1))), group.substr(0, colon));
+        if (!IN_MULTICAST(ntohl(group_addr.getAddr().sin_addr.s_addr)))
+        {
+            LOG(LogLevel::FATAL) << "无效的组播组：" << group;
+            exit(4);
+        }
+        usm->setMulticastGroup(group_addr.getAddr());
+        if (!udp_server->setMulticast(group_iface, [&usm](const struct sockaddr_in &addr)
+                                      { usm->joinMulticast(addr); }))
+            exit(static_cast<int>(ErrorNumber::SocketFail));
     }
 
+    // 按采样间隔追踪消息经过的各个阶段，退出时导出
+    Tracer::getInstance().setRate(trace_rate);
+
+    // 低延迟接收：接收线程绑核自旋，小房间不经过线程池
+    if (busy_cpu >= 0)
+        udp_server->setBusyPoll(busy_cpu, spin_us);
+
+    // 数据通道线程数随负载调整
+    if (adaptive_threads > 0)
+        udp_server->setAdaptive(adaptive_threads, adaptive_target_us);
+
+    // 记录所有收到的报文，使用replay_udp回放
+    if (!capture_path.empty())
+    {
+        std::shared_ptr<CaptureWriter> capture = std::make_shared<CaptureWriter>();
+        if (!capture->open(capture_path))
+        {
+            LOG(LogLevel::FATAL) << "抓包文件打开失败：" << capture_path << " " << strerror(errno);
+            exit(static_cast<int>(ErrorNumber::OpenLogFail));
+        }
+        udp_server->setCapture(capture);
+    }
+
+    std::unique_ptr<ConfigReloader> reloader = startReloader(config_path, base, [&usm](const ServerConfig &old, const ServerConfig &next)
+                                                             {
+        applyLogConfig(old, next);
+        if (next.data_threads != old.data_threads)
+            udp_server->setDataThreads(next.data_threads);
+        if (next.queue_limit != old.queue_limit)
+            udp_server->setQueueLimit(next.queue_limit);
+        if (next.recv_buffer != old.recv_buffer || next.send_buffer != old.send_buffer)
+            udp_server->setSocketBuffers(next.recv_buffer, next.send_buffer);
+        if (next.send_batch != old.send_batch)
+            usm->setSendBatch(next.send_batch); });
+
+    saver.start();
+
     udp_server->start();
 
+    // 先停止重新加载，之后不再访问服务器
+    if (reloader)
+        reloader->stop();
+
+    // 回收线程池并关闭套接字
+    udp_server.reset();
+
+    // 所有工作线程已经退出，导出追踪记录
+    if (trace_rate > 0)
+        Tracer::getInstance().exportTo(trace_path);
+
+    // 退出前保存最后一次快照
+    saver.stop();
+    LOG(LogLevel::INFO) << "成员变更 上线：" << usm->getJoins() << " 下线：" << usm->getLeaves();
+    LOG(LogLevel::INFO) << "服务器退出";
+
     return 0;
-}
\ No newline at end of file
+}
@@ -2,17 +2,35 @@
 
 #include <iostream>
 #include <string>
-#include <list>
+#include <string_view>
 #include <memory>
+#include <vector>
 #include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "sockaddr_in_t.hpp"
 #include "log.hpp"
+#include "fragment.hpp"
+#include "trace.hpp"
+#include "presence.hpp"
+#include "recipients.hpp"
 
 namespace UserManageModule
 {
     using namespace SockAddrInModule;
     using namespace LogSystemModule;
+    using namespace FragmentModule;
+    using namespace TraceModule;
+    using namespace PresenceModule;
+    using namespace RecipientModule;
+
+    const size_t d_send_batch = 64;    // 每次sendmmsg最多发送的消息数
+    const size_t max_send_batch = 256; // 运行时可设置的批量上限，决定栈上mmsghdr数组的大小
+    const uint64_t d_presence_full_ms = 1000; // 同一个地址两次全量在线列表之间的最短间隔
 
     // 观察者基类
     class UserObserver
@@ -27,30 +45,62 @@ namespace UserManageModule
     {
     public:
         User(uint16_t port, std::string ip, std::string name)
-            : _name(name), _sa_in(port, ip)
+            : _name(name), _sa_in(port, ip), _prefix(std::make_shared<const std::string>(formatPrefix(name, ip, port)))
         {
         }
 
-        virtual void sendMessage(int sockfd, const std::string &message) override
+        // 构建"名字 (IP:端口)："格式的发送者前缀
+        static std::string formatPrefix(const std::string &name, const std::string &ip, uint16_t port)
         {
-            // 打印日志
-            LOG(LogLevel::INFO) << "send message: " << message << "to: " << _sa_in.getIp() << ":" << _sa_in.getPort();
+            return name + " (" + ip + ":" + std::to_string(port) + ")：";
+        }
 
+        virtual void sendMessage(int sockfd, const std::string &message) override
+        {
             // 发送信息给自己
-            ssize_t ret = sendto(sockfd, message.c_str(), message.size(), 0, &_sa_in, _sa_in.getLength());
-            (void)ret;
+            sendMessage(sockfd, _sa_in.getAddr(), message);
         }
 
-        std::string getName()
+        // 发送给指定地址，用户管理按地址发送时使用
+        static void sendMessage(int sockfd, const struct sockaddr_in &addr, const std::string &message)
+        {
+            // 打印日志，控制帧只记录长度
+            if (!message.empty() && message[0] == frame_magic)
+                LOGB(LogLevel::INFO, "send frame: {} bytes to: {}", message.size(), addr);
+            else
+                LOGB(LogLevel::INFO, "send message: {}to: {}", message, addr);
+
+            ssize_t ret = sendto(sockfd, message.c_str(), message.size(), 0, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr));
+            if (ret < 0)
+                LOG(LogLevel::WARNING) << "send message failed: " << strerror(errno) << " to: " << SockAddrIn(addr).getIp() << ":" << ntohs(addr.sin_port);
+        }
+
+        std::string getName() const
         {
             return _name;
         }
 
+        bool hasName(const std::string &name) const
+        {
+            return _name == name;
+        }
+
         SockAddrIn getSockAddrIn()
         {
             return _sa_in;
         }
 
+        const struct sockaddr_in &getAddr() const
+        {
+            return _sa_in.getAddr();
+        }
+
+        // 获取预先构建的发送者前缀，上线时构建一次，之后不再修改
+        std::shared_ptr<const std::string> getPrefix() const
+        {
+            return _prefix;
+        }
+
         // 重载==
         bool operator==(const User &u)
         {
@@ -61,8 +111,12 @@ namespace UserManageModule
     private:
         std::string _name;
         SockAddrIn _sa_in;
+        std::shared_ptr<const std::string> _prefix; // 发送者前缀
     };
 
+    // 自定义发送方式，参数为发送者前缀和消息内容，返回true表示已经发送，返回false时按普通方式发送
+    using send_hook_t = std::function<bool(int, const struct sockaddr_in &, const std::string &, std::string_view)>;
+
     // 主题基类
     class UserManagerSubject
     {
@@ -72,16 +126,153 @@ namespace UserManageModule
         virtual void addUser(const User &user) = 0;
         // 删除方法
         virtual void delUser(const User &user) = 0;
-        // 通知方法
-        virtual void dispatchMessage(int sockfd, const std::string &message) = 0;
+        // 通知方法，发送的内容为发送者前缀 + 消息，chunks大于1时只发送给第chunk段用户
+        virtual void dispatchMessage(int sockfd, const std::string &prefix, std::string_view message, size_t chunk = 0, size_t chunks = 1) = 0;
     };
 
     // 主题实现类
+    // 用户保存在接收者表中，每次增删用户后发布一份单播地址快照，分发时只持有快照的引用，不持有锁
     class UserManager : public UserManagerSubject
     {
+    private:
+        // 优先使用自定义发送方式
+        void sendTo(int sockfd, const struct sockaddr_in &addr, const std::string &message)
+        {
+            static const std::string empty;
+            if (!_send_hook || !_send_hook(sockfd, addr, message, empty))
+                User::sendMessage(sockfd, addr, message);
+        }
+
+        // 发送一批消息，sendmmsg部分成功时继续发送剩余部分
+        static void flushBatch(int sockfd, struct mmsghdr *msgs, size_t n)
+        {
+            size_t sent = 0;
+            while (sent < n)
+            {
+                int ret = sendmmsg(sockfd, msgs + sent, n - sent, 0);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    // 跳过发送失败的消息
+                    const struct sockaddr_in *addr = static_cast<const struct sockaddr_in *>(msgs[sent].msg_hdr.msg_name);
+                    LOG(LogLevel::WARNING) << "send message failed: " << strerror(errno) << " to: " << SockAddrIn(*addr).getIp() << ":" << ntohs(addr->sin_port);
+                    sent++;
+                    continue;
+                }
+                sent += ret;
+            }
+        }
+
+        // 前缀和消息作为两段iovec发送，不拼接字符串，所有用户共用同一组iovec
+        void sendBatch(int sockfd, const std::string &prefix, std::string_view message, const struct sockaddr_in *first, const struct sockaddr_in *last)
+        {
+            struct iovec iov[2];
+            iov[0].iov_base = const_cast<char *>(prefix.data());
+            iov[0].iov_len = prefix.size();
+            iov[1].iov_base = const_cast<char *>(message.data());
+            iov[1].iov_len = message.size();
+
+            struct mmsghdr msgs[max_send_batch];
+            size_t batch = _send_batch.load(std::memory_order_relaxed);
+            size_t n = 0;
+            for (const struct sockaddr_in *addr = first; addr != last; ++addr)
+            {
+                if (_send_hook && _send_hook(sockfd, *addr, prefix, message))
+                    continue;
+
+                struct msghdr &hdr = msgs[n].msg_hdr;
+                memset(&hdr, 0, sizeof(hdr));
+                hdr.msg_name = const_cast<struct sockaddr_in *>(addr);
+                hdr.msg_namelen = sizeof(struct sockaddr_in);
+                hdr.msg_iov = iov;
+                hdr.msg_iovlen = 2;
+
+                if (++n == batch)
+                {
+                    flushBatch(sockfd, msgs, n);
+                    n = 0;
+                }
+            }
+            flushBatch(sockfd, msgs, n);
+        }
+
+        // 前缀和消息一次发送到组播组
+        void sendGroup(int sockfd, const std::string &prefix, std::string_view message)
+        {
+            if (_fragmenter.needSplit(prefix.size() + message.size()))
+            {
+                std::string whole = prefix;
+                whole.append(message.data(), message.size());
+                for (auto &frame : _fragmenter.split(whole))
+                    sendto(sockfd, frame.data(), frame.size(), 0, reinterpret_cast<const struct sockaddr *>(&_group), sizeof(_group));
+                return;
+            }
+
+            struct iovec iov[2];
+            iov[0].iov_base = const_cast<char *>(prefix.data());
+            iov[0].iov_len = prefix.size();
+            iov[1].iov_base = const_cast<char *>(message.data());
+            iov[1].iov_len = message.size();
+
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &_group;
+            hdr.msg_namelen = sizeof(_group);
+            hdr.msg_iov = iov;
+            hdr.msg_iovlen = 2;
+            if (sendmsg(sockfd, &hdr, 0) < 0)
+                LOG(LogLevel::WARNING) << "send multicast failed: " << strerror(errno);
+        }
+
+        // 按名字和地址查找用户，不存在时返回invalid_handle，调用方持有锁
+        recipient_handle_t findUser(const User &user)
+        {
+            auto it = _by_name.find(_names.find(user.getName()));
+            if (it == _by_name.end())
+                return invalid_handle;
+
+            uint64_t key = addrKey(user.getAddr());
+            for (recipient_handle_t handle : it->second)
+                if (addrKey(_table.getAddr(handle)) == key)
+                    return handle;
+            return invalid_handle;
+        }
+
+        // 插入用户并登记索引，调用方持有锁
+        void insertUser(const User &user)
+        {
+            name_id_t name = _names.intern(user.getName());
+            recipient_handle_t handle = _table.add(user.getAddr(), name, user.getPrefix());
+            _by_addr[addrKey(user.getAddr())] = handle;
+            _by_name[name].push_back(handle);
+            _version++;
+            _presence.record(_version, true, user.getAddr(), user.getName());
+        }
+
+        // 成员变更后只标记快照过期，不立即重建，上线风暴时不会每次变更都拷贝整个列表，调用方持有锁
+        void publish()
+        {
+            _dirty = true;
+        }
+
+        // 获取单播地址快照，过期时按当前用户表重建，正在分发的任务继续使用旧快照，调用方持有锁
+        std::shared_ptr<const recipient_list_t> snapshot()
+        {
+            if (_dirty)
+            {
+                _recipients = std::make_shared<const recipient_list_t>(_table.unicastList());
+                _dirty = false;
+            }
+            return _recipients;
+        }
+
     public:
         UserManager()
+            : _recipients(std::make_shared<const recipient_list_t>()), _dirty(false), _version(0), _joins(0), _leaves(0), _multicast_members(0)
         {
+            memset(&_group, 0, sizeof(_group));
         }
 
         // 实现添加方法
@@ -90,52 +281,285 @@ namespace UserManageModule
             // 先申请锁
             MutexGuard guard(_mutex);
             // 确保用户不存在
-            for (auto &u : _u_list)
-                if (*u == user)
-                {
-                    LOG(LogLevel::INFO) << "用户已存在";
-                    return;
-                }
+            if (findUser(user) != invalid_handle)
+            {
+                LOG(LogLevel::INFO) << "用户已存在";
+                return;
+            }
+
+            insertUser(user);
+            publish();
+            _joins++;
+
+            LOGB(LogLevel::INFO, "用户上线：{} 在线：{} 版本：{}", user.getName(), _table.size(), _version);
+        }
+
+        // 实现删除方法
+        virtual void delUser(const User &user) override
+        {
+            MutexGuard guard(_mutex);
 
-            // 不存在时插入
-            _u_list.push_back(std::make_shared<User>(user));
+            recipient_handle_t handle = findUser(user);
+            if (handle == invalid_handle)
+                return;
 
-            // 打印当前在线用户
-            printUsers();
+            if (_table.isMulticast(handle))
+                _multicast_members--;
+            _version++;
+            _presence.record(_version, false, user.getAddr(), user.getName());
+            _leaves++;
+
+            auto it = _by_addr.find(addrKey(user.getAddr()));
+            if (it != _by_addr.end() && it->second == handle)
+            {
+                _by_addr.erase(it);
+                _full_presence_ms.erase(addrKey(user.getAddr()));
+            }
+
+            name_id_t name = _table.getInfo(handle).name;
+            std::vector<recipient_handle_t> &handles = _by_name[name];
+            handles.erase(std::find(handles.begin(), handles.end(), handle));
+            if (handles.empty())
+                _by_name.erase(name);
+
+            // 与表尾交换后弹出，其余用户的句柄不变
+            _table.remove(handle);
+            _names.release(name);
+            publish();
+            LOGB(LogLevel::INFO, "用户下线：{} 在线：{} 版本：{}", user.getName(), _table.size(), _version);
         }
 
-        void printUsers()
+        // 通知方法
+        virtual void dispatchMessage(int sockfd, const std::string &prefix, std::string_view message, size_t chunk = 0, size_t chunks = 1) override
         {
-            for (auto &u : _u_list)
+            // 只在取快照时加锁，发送期间成员变更不会被阻塞
+            std::shared_ptr<const recipient_list_t> users;
+            size_t multicast_members = 0;
             {
-                LOG(LogLevel::INFO) << "当前在线用户：" << u->getName() << "(" << u->getSockAddrIn().getIp() << ":" << u->getSockAddrIn().getPort() << ")";
+                MutexGuard guard(_mutex);
+                users = snapshot();
+                multicast_members = _multicast_members;
             }
+            Tracer::mark(TraceStage::Locked);
+
+            // 有组播成员时第一段任务发送一次到组播组，快照中只有其余用户
+            if (multicast_members > 0 && chunk == 0)
+                sendGroup(sockfd, prefix, message);
+
+            // 计算本段负责的用户范围
+            size_t n = users->size();
+            const struct sockaddr_in *first = users->data() + n * chunk / chunks;
+            const struct sockaddr_in *last = users->data() + n * (chunk + 1) / chunks;
+
+            LOGB(LogLevel::INFO, "分发任务，用户数：{} 长度：{}", last - first, prefix.size() + message.size());
+
+            // 超长消息切分后发送
+            if (_fragmenter.needSplit(prefix.size() + message.size()))
+            {
+                std::string whole = prefix;
+                whole.append(message.data(), message.size());
+                std::vector<std::string> frames = _fragmenter.split(whole);
+                for (const struct sockaddr_in *addr = first; addr != last; ++addr)
+                    for (auto &frame : frames)
+                        sendTo(sockfd, *addr, frame);
+                return;
+            }
+
+            sendBatch(sockfd, prefix, message, first, last);
         }
 
-        // 实现删除方法
-        virtual void delUser(const User &user) override
+        // 私信：只发送给该名字下登记的所有地址，名字不存在时返回false
+        bool sendDirect(int sockfd, const std::string &name, const std::string &prefix, std::string_view message)
+        {
+            recipient_list_t targets = findByName(name);
+            if (targets.empty())
+                return false;
+
+            LOGB(LogLevel::INFO, "私信：{} 地址数：{} 长度：{}", name, targets.size(), prefix.size() + message.size());
+
+            std::string whole = prefix;
+            whole.append(message.data(), message.size());
+            if (_fragmenter.needSplit(whole.size()))
+            {
+                std::vector<std::string> frames = _fragmenter.split(whole);
+                for (auto &addr : targets)
+                    for (auto &frame : frames)
+                        sendTo(sockfd, addr, frame);
+                return true;
+            }
+
+            for (auto &addr : targets)
+                sendTo(sockfd, addr, whole);
+            return true;
+        }
+
+        // 设置组播组地址，需要在服务器启动之前调用
+        void setMulticastGroup(const struct sockaddr_in &group)
+        {
+            _group = group;
+        }
+
+        // 客户端加入组播组后改为组播接收，从单播快照中移除
+        void joinMulticast(const struct sockaddr_in &addr)
         {
             MutexGuard guard(_mutex);
+            auto found = _by_addr.find(addrKey(addr));
+            if (found == _by_addr.end() || _table.isMulticast(found->second))
+                return;
 
-            auto pos = std::remove_if(_u_list.begin(), _u_list.end(), [&user](std::shared_ptr<User> &u)
-                                      { return *u == user; });
+            _table.setMulticast(found->second);
+            publish();
+            _multicast_members++;
+            LOG(LogLevel::INFO) << "用户加入组播：" << _names.get(_table.getInfo(found->second).name);
+        }
 
-            _u_list.erase(pos, _u_list.end());
-            // 打印当前在线用户
-            printUsers();
+        size_t getUserCount()
+        {
+            MutexGuard guard(_mutex);
+            return _table.size();
         }
 
-        // 通知方法
-        virtual void dispatchMessage(int sockfd, const std::string &message) override
+        // 根据地址和名字查找已上线用户的发送者前缀，找不到时返回空指针
+        std::shared_ptr<const std::string> findPrefix(const struct sockaddr_in &addr, const std::string &name)
+        {
+            MutexGuard guard(_mutex);
+            auto it = _by_addr.find(addrKey(addr));
+            if (it == _by_addr.end())
+                return nullptr;
+            const RecipientInfo &info = _table.getInfo(it->second);
+            if (_names.get(info.name) != name)
+                return nullptr;
+            return info.prefix;
+        }
+
+        // 设置自定义发送方式，需要在服务器启动之前调用
+        void setSendHook(send_hook_t hook)
+        {
+            _send_hook = hook;
+        }
+
+        // 获取当前单播地址快照，快照本身不会再被修改，调用方可以不持有锁遍历
+        std::shared_ptr<const recipient_list_t> getUserList()
+        {
+            MutexGuard guard(_mutex);
+            return snapshot();
+        }
+
+        // 获取名字下登记的所有地址，名字不存在时返回空列表
+        recipient_list_t findByName(const std::string &name)
+        {
+            MutexGuard guard(_mutex);
+            recipient_list_t addrs;
+            auto it = _by_name.find(_names.find(name));
+            if (it == _by_name.end())
+                return addrs;
+            for (recipient_handle_t handle : it->second)
+                addrs.push_back(_table.getAddr(handle));
+            return addrs;
+        }
+
+        // 获取当前在线用户的拷贝
+        std::vector<User> getUsers()
+        {
+            MutexGuard guard(_mutex);
+            std::vector<User> users;
+            users.reserve(_table.size());
+            for (size_t i = 0; i < _table.size(); i++)
+            {
+                SockAddrIn addr(_table.addrAt(i));
+                users.emplace_back(addr.getPort(), addr.getIp(), _names.get(_table.infoAt(i).name));
+            }
+            return users;
+        }
+
+        // 批量恢复用户，用于服务器重启后从快照加载
+        void restoreUsers(const std::vector<User> &users)
+        {
+            MutexGuard guard(_mutex);
+            for (auto &user : users)
+                if (findUser(user) == invalid_handle)
+                    insertUser(user);
+            publish();
+        }
+
+        // 在线列表查询：客户端已知版本之后的变更编码为增量报文，日志中没有需要的变更或纪元不同时编码为全量报文
+        // 只回复已上线的地址，否则任何人都能用伪造的源地址把整个列表反射给别人，也能拿到所有用户的地址
+        // 全量报文较大，同一个地址每个间隔最多回复一次，被限制时不回复，客户端稍后重新查询
+        std::vector<std::string> presenceUpdates(const struct sockaddr_in &from, uint32_t epoch, uint64_t version)
+        {
+            std::vector<PresenceChange> changes;
+            uint64_t current = 0;
+            uint32_t server_epoch = 0;
+            bool delta = false;
+            {
+                MutexGuard guard(_mutex);
+                uint64_t key = addrKey(from);
+                if (_by_addr.find(key) == _by_addr.end())
+                    return {};
+
+                current = _version;
+                server_epoch = _presence.getEpoch();
+                delta = _presence.since(epoch, version, current, changes);
+                if (!delta)
+                {
+                    uint64_t now = nowMs();
+                    auto last = _full_presence_ms.find(key);
+                    if (last != _full_presence_ms.end() && now - last->second < d_presence_full_ms)
+                        return {};
+                    _full_presence_ms[key] = now;
+
+                    changes.reserve(_table.size());
+                    for (size_t i = 0; i < _table.size(); i++)
+                        changes.push_back(PresenceChange{current, true, _table.addrAt(i), _names.get(_table.infoAt(i).name)});
+                }
+            }
+
+            return encodePresence(server_epoch, delta ? version : 0, current, !delta, changes);
+        }
+
+        // 成员变更计数
+        uint64_t getJoins()
+        {
+            MutexGuard guard(_mutex);
+            return _joins;
+        }
+
+        uint64_t getLeaves()
+        {
+            MutexGuard guard(_mutex);
+            return _leaves;
+        }
+
+        // 设置每次sendmmsg最多发送的消息数，范围[1, max_send_batch]，下一次分发开始生效
+        void setSendBatch(size_t batch)
+        {
+            _send_batch.store(std::clamp<size_t>(batch, 1, max_send_batch), std::memory_order_relaxed);
+        }
+
+        // 用户列表版本号，每次增删用户时递增
+        uint64_t getVersion()
         {
             MutexGuard guard(_mutex);
-            LOG(LogLevel::INFO) << "分发任务";
-            for (auto &u : _u_list)
-                u->sendMessage(sockfd, message);
+            return _version;
         }
 
     private:
-        std::list<std::shared_ptr<User>> _u_list; // 用户链表
-        Mutex _mutex;                             // 链表互斥锁
+        RecipientTable _table;                                // 所有在线用户
+        NameTable _names;                                     // 用户名字，同名用户共用一份
+        std::shared_ptr<const recipient_list_t> _recipients;  // 单播地址快照，只整体替换
+        bool _dirty;                                          // 快照是否落后于用户表，下次读取时重建
+        std::unordered_map<uint64_t, recipient_handle_t> _by_addr;                // 地址 -> 用户，用于查找发送者前缀
+        std::unordered_map<name_id_t, std::vector<recipient_handle_t>> _by_name;  // 名字 -> 该名字下的所有用户，用于私信
+        Mutex _mutex;                             // 用户列表互斥锁
+        uint64_t _version;                        // 用户列表版本号
+        PresenceLog _presence;                    // 成员变更日志，用于在线列表的增量同步
+        std::unordered_map<uint64_t, uint64_t> _full_presence_ms; // 在线地址 -> 上次回复全量列表的时间
+        uint64_t _joins;                          // 上线次数
+        uint64_t _leaves;                         // 下线次数
+        send_hook_t _send_hook;                   // 自定义发送方式
+        struct sockaddr_in _group;                // 组播组地址
+        size_t _multicast_members;                // 组播成员数，为0时不发送组播
+        Fragmenter _fragmenter;                   // 超长消息分片
+        std::atomic<size_t> _send_batch{d_send_batch}; // 每次sendmmsg最多发送的消息数
     };
-}
\ No newline at end of file
+}
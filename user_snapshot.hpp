@@ -0,0 +1,306 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "user.hpp"
+#include "thread.hpp"
+#include "log.hpp"
+
+namespace UserSnapshotModule
+{
+    using namespace UserManageModule;
+    using namespace ThreadModule;
+    using namespace LogSystemModule;
+
+    // 默认快照文件路径和保存间隔（秒）
+    const std::string d_snapshot_path = "./users.snap";
+    const int d_snapshot_interval = 5;
+
+    // 快照文件格式（小端主机序，仅供本机重启使用）：
+    // [magic 4B "UCSN"][version 2B][reserved 2B][count 4B][checksum 4B]
+    // 每个用户：[ip 4B 网络序][port 2B 网络序][name_len 2B][name]
+    const uint32_t snapshot_magic = 0x4E534355; // "UCSN"
+    const uint16_t snapshot_version = 1;
+    const size_t snapshot_header_size = 16;
+
+    // FNV-1a校验和，用于识别写了一半的快照
+    inline uint32_t fnv1a(const char *data, size_t len)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; i++)
+        {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    class UserSnapshot
+    {
+    private:
+        template <class T>
+        static void append(std::string &out, const T &value)
+        {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        template <class T>
+        static T extract(const char *p)
+        {
+            T value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+    public:
+        UserSnapshot(const std::string &path = d_snapshot_path)
+            : _path(path)
+        {
+        }
+
+        // 将用户列表写入快照文件，先写临时文件再rename，保证文件始终完整
+        bool save(const std::vector<User> &users)
+        {
+            std::string body;
+            body.reserve(users.size() * 24);
+            uint32_t count = 0; // 实际写入的记录数，跳过的用户不计入
+            for (auto user : users)
+            {
+                SockAddrIn sa = user.getSockAddrIn();
+                std::string name = user.getName();
+                struct in_addr addr;
+                if (inet_pton(AF_INET, sa.getIp().c_str(), &addr) != 1 || name.size() > UINT16_MAX)
+                    continue;
+
+                append(body, addr.s_addr);
+                append(body, htons(sa.getPort()));
+                append(body, static_cast<uint16_t>(name.size()));
+                body += name;
+                count++;
+            }
+
+            std::string data;
+            data.reserve(snapshot_header_size + body.size());
+            append(data, snapshot_magic);
+            append(data, snapshot_version);
+            append(data, static_cast<uint16_t>(0));
+            append(data, count);
+            append(data, fnv1a(body.data(), body.size()));
+            data += body;
+
+            const std::string tmp_path = _path + ".tmp";
+            int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                LOG(LogLevel::WARNING) << "快照文件打开失败：" << tmp_path << " " << strerror(errno);
+                return false;
+            }
+
+            size_t written = 0;
+            while (written < data.size())
+            {
+                ssize_t n = write(fd, data.data() + written, data.size() - written);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    LOG(LogLevel::WARNING) << "快照写入失败：" << strerror(errno);
+                    close(fd);
+                    unlink(tmp_path.c_str());
+                    return false;
+                }
+                written += n;
+            }
+
+            fdatasync(fd);
+            close(fd);
+
+            if (rename(tmp_path.c_str(), _path.c_str()) < 0)
+            {
+                LOG(LogLevel::WARNING) << "快照替换失败：" << strerror(errno);
+                unlink(tmp_path.c_str());
+                return false;
+            }
+
+            return true;
+        }
+
+        // 读取快照文件，文件不存在或者损坏时返回空列表
+        std::vector<User> load()
+        {
+            std::vector<User> users;
+
+            int fd = open(_path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                if (errno != ENOENT)
+                    LOG(LogLevel::WARNING) << "快照文件打开失败：" << _path << " " << strerror(errno);
+                return users;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(snapshot_header_size))
+            {
+                close(fd);
+                LOG(LogLevel::WARNING) << "快照文件不完整：" << _path;
+                return users;
+            }
+
+            // 一次性读入整个文件
+            std::string data(st.st_size, '\0');
+            size_t nread = 0;
+            while (nread < data.size())
+            {
+                ssize_t n = read(fd, &data[nread], data.size() - nread);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                nread += n;
+            }
+            close(fd);
+
+            if (nread != data.size())
+            {
+                LOG(LogLevel::WARNING) << "快照文件读取失败：" << _path;
+                return users;
+            }
+
+            const char *p = data.data();
+            uint32_t magic = extract<uint32_t>(p);
+            uint16_t version = extract<uint16_t>(p + 4);
+            uint32_t count = extract<uint32_t>(p + 8);
+            uint32_t checksum = extract<uint32_t>(p + 12);
+
+            const char *body = p + snapshot_header_size;
+            size_t body_len = data.size() - snapshot_header_size;
+            if (magic != snapshot_magic || version != snapshot_version || checksum != fnv1a(body, body_len))
+            {
+                LOG(LogLevel::WARNING) << "快照文件校验失败，忽略：" << _path;
+                return users;
+            }
+
+            users.reserve(count);
+            size_t off = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (off + 8 > body_len)
+                    break;
+
+                struct in_addr addr;
+                addr.s_addr = extract<uint32_t>(body + off);
+                uint16_t port = ntohs(extract<uint16_t>(body + off + 4));
+                uint16_t name_len = extract<uint16_t>(body + off + 6);
+                off += 8;
+
+                if (off + name_len > body_len)
+                    break;
+
+                char ip[INET_ADDRSTRLEN] = {0};
+                inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+                users.emplace_back(port, ip, std::string(body + off, name_len));
+                off += name_len;
+            }
+
+            return users;
+        }
+
+        std::string getPath()
+        {
+            return _path;
+        }
+
+    private:
+        std::string _path; // 快照文件路径
+    };
+
+    // 定期保存快照，仅在在线用户发生变化时写文件
+    class SnapshotSaver
+    {
+    private:
+        void run()
+        {
+            int ticks = 0;
+            while (_isRunning)
+            {
+                // 以100ms为单位休眠，保证停止时能及时退出
+                usleep(100 * 1000);
+                if (++ticks < _interval * 10)
+                    continue;
+
+                ticks = 0;
+                saveIfChanged();
+            }
+        }
+
+    public:
+        SnapshotSaver(UserManager &usm, const std::string &path = d_snapshot_path, int interval = d_snapshot_interval)
+            : _usm(usm), _snapshot(path), _interval(interval), _saved_version(0), _isRunning(false),
+              _thread([this]()
+                      { run(); })
+        {
+        }
+
+        // 启动时恢复快照中的用户
+        size_t restore()
+        {
+            std::vector<User> users = _snapshot.load();
+            _usm.restoreUsers(users);
+            _saved_version = _usm.getVersion();
+
+            LOG(LogLevel::INFO) << "从快照恢复用户：" << users.size() << " 文件：" << _snapshot.getPath();
+            return users.size();
+        }
+
+        // 用户列表有变化时保存
+        void saveIfChanged()
+        {
+            uint64_t version = _usm.getVersion();
+            if (version == _saved_version)
+                return;
+
+            if (_snapshot.save(_usm.getUsers()))
+                _saved_version = version;
+        }
+
+        void start()
+        {
+            if (_interval <= 0 || _isRunning)
+                return;
+
+            _isRunning = true;
+            _thread.start();
+        }
+
+        // 停止定期保存并写入最后一次快照
+        void stop()
+        {
+            if (_isRunning)
+            {
+                _isRunning = false;
+                _thread.join();
+            }
+
+            saveIfChanged();
+        }
+
+        ~SnapshotSaver()
+        {
+        }
+
+    private:
+        UserManager &_usm;
+        UserSnapshot _snapshot;
+        int _interval;           // 保存间隔（秒）
+        uint64_t _saved_version; // 最后一次保存时的用户列表版本
+        volatile bool _isRunning;
+        Thread _thread;
+    };
+}